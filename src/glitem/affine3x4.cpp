@@ -0,0 +1,173 @@
+#include "affine3x4.h"
+#include <qmath.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+
+Affine3x4 Affine3x4::identity()
+{
+    Affine3x4 a = {{ { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 } }};
+    return a;
+}
+
+Affine3x4 Affine3x4::fromMatrix(const QMatrix4x4 &matrix)
+{
+    Affine3x4 a;
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 4; c++)
+            a.m[r][c] = matrix(r, c);
+    }
+    return a;
+}
+
+void Affine3x4::toMatrix(QMatrix4x4 &out) const
+{
+    const float values[16] = {
+        m[0][0], m[0][1], m[0][2], m[0][3],
+        m[1][0], m[1][1], m[1][2], m[1][3],
+        m[2][0], m[2][1], m[2][2], m[2][3],
+        0, 0, 0, 1
+    };
+    out = QMatrix4x4(values);
+}
+
+Affine3x4 Affine3x4::translation(const QVector3D &t)
+{
+    Affine3x4 a = identity();
+    a.m[0][3] = t.x();
+    a.m[1][3] = t.y();
+    a.m[2][3] = t.z();
+    return a;
+}
+
+// translation part of a linear part applied about origin, o - L * o
+static void aboutOrigin(Affine3x4 &a, const QVector3D &origin)
+{
+    for (int r = 0; r < 3; r++) {
+        a.m[r][3] = origin[r] - (a.m[r][0] * origin.x() +
+                                 a.m[r][1] * origin.y() +
+                                 a.m[r][2] * origin.z());
+    }
+}
+
+Affine3x4 Affine3x4::scaling(const QVector3D &s, const QVector3D &origin)
+{
+    Affine3x4 a = identity();
+    a.m[0][0] = s.x();
+    a.m[1][1] = s.y();
+    a.m[2][2] = s.z();
+    aboutOrigin(a, origin);
+    return a;
+}
+
+Affine3x4 Affine3x4::rotation(float angle, const QVector3D &axis, const QVector3D &origin)
+{
+    float x = axis.x(), y = axis.y(), z = axis.z();
+    float len = qSqrt(x * x + y * y + z * z);
+    if (len > 0) {
+        x /= len;
+        y /= len;
+        z /= len;
+    }
+
+    float radians = qDegreesToRadians(angle);
+    float c = qCos(radians), s = qSin(radians), ic = 1 - c;
+
+    Affine3x4 a = {{
+        { x * x * ic + c, x * y * ic - z * s, x * z * ic + y * s, 0 },
+        { y * x * ic + z * s, y * y * ic + c, y * z * ic - x * s, 0 },
+        { x * z * ic - y * s, y * z * ic + x * s, z * z * ic + c, 0 }
+    }};
+    aboutOrigin(a, origin);
+    return a;
+}
+
+void Affine3x4::multiply(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out)
+{
+    // row i of the result is a[i][0] * b0 + a[i][1] * b1 + a[i][2] * b2
+    // plus a[i][3] in the translation column
+#ifdef __SSE2__
+    const __m128 b0 = _mm_loadu_ps(b.m[0]);
+    const __m128 b1 = _mm_loadu_ps(b.m[1]);
+    const __m128 b2 = _mm_loadu_ps(b.m[2]);
+    const __m128 w = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+
+    __m128 r[3];
+    for (int i = 0; i < 3; i++) {
+        __m128 ar = _mm_loadu_ps(a.m[i]);
+        __m128 v = _mm_mul_ps(_mm_shuffle_ps(ar, ar, _MM_SHUFFLE(0, 0, 0, 0)), b0);
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(ar, ar, _MM_SHUFFLE(1, 1, 1, 1)), b1));
+        v = _mm_add_ps(v, _mm_mul_ps(_mm_shuffle_ps(ar, ar, _MM_SHUFFLE(2, 2, 2, 2)), b2));
+        r[i] = _mm_add_ps(v, _mm_and_ps(ar, w));
+    }
+    for (int i = 0; i < 3; i++)
+        _mm_storeu_ps(out.m[i], r[i]);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const float32x4_t b0 = vld1q_f32(b.m[0]);
+    const float32x4_t b1 = vld1q_f32(b.m[1]);
+    const float32x4_t b2 = vld1q_f32(b.m[2]);
+
+    float32x4_t r[3];
+    for (int i = 0; i < 3; i++) {
+        float32x4_t v = vsetq_lane_f32(a.m[i][3], vdupq_n_f32(0), 3);
+        v = vmlaq_n_f32(v, b0, a.m[i][0]);
+        v = vmlaq_n_f32(v, b1, a.m[i][1]);
+        r[i] = vmlaq_n_f32(v, b2, a.m[i][2]);
+    }
+    for (int i = 0; i < 3; i++)
+        vst1q_f32(out.m[i], r[i]);
+#else
+    Affine3x4 r;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            r.m[i][j] = a.m[i][0] * b.m[0][j] +
+                        a.m[i][1] * b.m[1][j] +
+                        a.m[i][2] * b.m[2][j];
+        }
+        r.m[i][3] += a.m[i][3];
+    }
+    out = r;
+#endif
+}
+
+QMatrix3x3 Affine3x4::normalMatrix() const
+{
+    // the inverse transpose is the cofactor matrix over the determinant,
+    // its rows are cross products of the rows
+    float c[3][4];
+#ifdef __SSE2__
+    const __m128 r0 = _mm_loadu_ps(m[0]);
+    const __m128 r1 = _mm_loadu_ps(m[1]);
+    const __m128 r2 = _mm_loadu_ps(m[2]);
+#define CROSS(a, b) _mm_sub_ps( \
+    _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 1, 0, 2))), \
+    _mm_mul_ps(_mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 1, 0, 2)), _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1))))
+    _mm_storeu_ps(c[0], CROSS(r1, r2));
+    _mm_storeu_ps(c[1], CROSS(r2, r0));
+    _mm_storeu_ps(c[2], CROSS(r0, r1));
+#undef CROSS
+#else
+    for (int i = 0; i < 3; i++) {
+        const float *a = m[(i + 1) % 3], *b = m[(i + 2) % 3];
+        c[i][0] = a[1] * b[2] - a[2] * b[1];
+        c[i][1] = a[2] * b[0] - a[0] * b[2];
+        c[i][2] = a[0] * b[1] - a[1] * b[0];
+    }
+#endif
+
+    QMatrix3x3 normal;
+    float det = m[0][0] * c[0][0] + m[0][1] * c[0][1] + m[0][2] * c[0][2];
+    // only exactly singular, small uniform scales are valid
+    if (det == 0.0f)
+        return normal;
+
+    float inv = 1 / det;
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++)
+            normal(i, j) = c[i][j] * inv;
+    }
+    return normal;
+}
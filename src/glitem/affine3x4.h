@@ -0,0 +1,31 @@
+#ifndef AFFINE3X4_H
+#define AFFINE3X4_H
+
+#include <QMatrix4x4>
+#include <QGenericMatrix>
+
+// Affine transform kept as the top three rows of a 4x4 matrix, row
+// major with the translation in the last column, the bottom row is
+// always 0 0 0 1. Composing two costs 36 multiplies instead of 64 and
+// is done a row per SSE or NEON vector where available.
+struct Affine3x4 {
+    float m[3][4];
+
+    static Affine3x4 identity();
+    // the bottom row of matrix is dropped
+    static Affine3x4 fromMatrix(const QMatrix4x4 &matrix);
+    void toMatrix(QMatrix4x4 &out) const;
+
+    static Affine3x4 translation(const QVector3D &t);
+    // scale and rotation about origin, rotation like QMatrix4x4::rotate()
+    static Affine3x4 scaling(const QVector3D &s, const QVector3D &origin);
+    static Affine3x4 rotation(float angle, const QVector3D &axis, const QVector3D &origin);
+
+    // out = a * b, out may be a or b
+    static void multiply(const Affine3x4 &a, const Affine3x4 &b, Affine3x4 &out);
+    // inverse transpose of the 3x3 part, identity when it is singular
+    // like QMatrix4x4::normalMatrix()
+    QMatrix3x3 normalMatrix() const;
+};
+
+#endif // AFFINE3X4_H
@@ -40,17 +40,48 @@
 ****************************************************************************/
 
 #include "ailoaderiostream.h"
+#include "ailoaderiosystem.h"
 
 #include <QIODevice>
+#include <QFile>
 #include <QDebug>
 
 AiLoaderIOStream::AiLoaderIOStream(QIODevice *device)
     : m_device(device)
     , m_errorState(false)
+    , m_system(0)
+    , m_in_memory(false)
+    , m_data(0)
+    , m_size(0)
+    , m_pos(0)
 {
     Q_ASSERT(device);
 }
 
+AiLoaderIOStream::AiLoaderIOStream(QFile *file, AiLoaderIOSystem *system)
+    : m_device(file)
+    , m_errorState(false)
+    , m_system(system)
+    , m_in_memory(true)
+    , m_data(0)
+    , m_size(file->size())
+    , m_pos(0)
+{
+    Q_ASSERT(file && system);
+
+    if (m_size > 0)
+        m_data = file->map(0, m_size);
+    if (m_data) {
+        m_system->m_mapped_bytes += m_size;
+    }
+    else {
+        m_buffer = file->readAll();
+        m_data = (const uchar *)m_buffer.constData();
+        m_size = m_buffer.size();
+        m_system->m_preloaded_bytes += m_size;
+    }
+}
+
 AiLoaderIOStream::~AiLoaderIOStream()
 {
     delete m_device;
@@ -58,6 +89,17 @@ AiLoaderIOStream::~AiLoaderIOStream()
 
 size_t AiLoaderIOStream::Read( void* pvBuffer, size_t pSize, size_t pCount)
 {
+    if (m_in_memory)
+    {
+        // assimp wants the number of whole items read
+        size_t count = pSize ? qMin(pCount, size_t(m_size - m_pos) / pSize) : 0;
+        memcpy(pvBuffer, m_data + m_pos, count * pSize);
+        m_pos += count * pSize;
+        m_system->m_read_count++;
+        m_system->m_read_bytes += count * pSize;
+        return count;
+    }
+
     qint64 result = m_device->read((char*)pvBuffer, pSize * pCount);
     size_t res = result;
     m_errorState = (result == -1);
@@ -76,6 +118,9 @@ size_t AiLoaderIOStream::Read( void* pvBuffer, size_t pSize, size_t pCount)
 
 size_t AiLoaderIOStream::Write( const void* pvBuffer, size_t pSize, size_t pCount)
 {
+    if (m_in_memory)
+        return 0;
+
     qint64 result = m_device->write((char*)pvBuffer, pSize * pCount);
     m_errorState = (result == -1);
     if (m_errorState)
@@ -85,6 +130,30 @@ size_t AiLoaderIOStream::Write( const void* pvBuffer, size_t pSize, size_t pCoun
 
 aiReturn AiLoaderIOStream::Seek(size_t pOffset, aiOrigin pOrigin)
 {
+    if (m_in_memory)
+    {
+        // offsets are unsigned, backward seeks wrap around
+        qint64 pos;
+        switch (pOrigin)
+        {
+        case aiOrigin_SET:
+            pos = qint64(pOffset);
+            break;
+        case aiOrigin_CUR:
+            pos = m_pos + qint64(pOffset);
+            break;
+        case aiOrigin_END:
+            pos = m_size + qint64(pOffset);
+            break;
+        default:
+            return aiReturn_FAILURE;
+        }
+        if (pos < 0 || pos > m_size)
+            return aiReturn_FAILURE;
+        m_pos = pos;
+        return aiReturn_SUCCESS;
+    }
+
     // cannot deal with sockets right now
     Q_ASSERT(!m_device->isSequential());
     switch (pOrigin)
@@ -109,11 +178,15 @@ aiReturn AiLoaderIOStream::Seek(size_t pOffset, aiOrigin pOrigin)
 
 size_t AiLoaderIOStream::Tell() const
 {
+    if (m_in_memory)
+        return m_pos;
     return m_device->pos();
 }
 
 size_t AiLoaderIOStream::FileSize() const
 {
+    if (m_in_memory)
+        return m_size;
     return m_device->size();
 }
 
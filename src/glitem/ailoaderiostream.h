@@ -43,17 +43,24 @@
 #define AILOADERIOSTREAM_H
 
 #include <QtGlobal>
+#include <QByteArray>
 #include <assimp/IOStream.hpp>
 #include <assimp/IOSystem.hpp>
 
 QT_BEGIN_NAMESPACE
 class QIODevice;
+class QFile;
 QT_END_NAMESPACE
 
+class AiLoaderIOSystem;
+
 class AiLoaderIOStream : public Assimp::IOStream
 {
 public:
     AiLoaderIOStream(QIODevice *device);
+    // read only stream served from memory, the file is mapped when
+    // possible and read whole otherwise, e.g. compressed resources
+    AiLoaderIOStream(QFile *file, AiLoaderIOSystem *system);
     ~AiLoaderIOStream();
     size_t Read( void* pvBuffer, size_t pSize, size_t pCount);
     size_t Write( const void* pvBuffer, size_t pSize, size_t pCount);
@@ -65,6 +72,13 @@ public:
 private:
     QIODevice *m_device;
     bool m_errorState;
+
+    AiLoaderIOSystem *m_system;
+    bool m_in_memory;
+    QByteArray m_buffer;
+    const uchar *m_data;
+    qint64 m_size;
+    qint64 m_pos;
 };
 
 #endif // AILOADERIOSTREAM_H
@@ -48,6 +48,11 @@
 #include <QDebug>
 
 AiLoaderIOSystem::AiLoaderIOSystem()
+    : m_open_count(0)
+    , m_read_count(0)
+    , m_read_bytes(0)
+    , m_mapped_bytes(0)
+    , m_preloaded_bytes(0)
 {
 }
 
@@ -122,6 +127,11 @@ Assimp::IOStream* AiLoaderIOSystem::Open(const char* pFile, const char* pMode)
         delete f;
         return 0;
     }
+    m_open_count++;
+
+    // format readers do lots of tiny reads, serve them from memory
+    if (mode == QIODevice::ReadOnly)
+        return new AiLoaderIOStream(f, this);
     return new AiLoaderIOStream(f);
 }
 
@@ -130,4 +140,6 @@ void AiLoaderIOSystem::Close(Assimp::IOStream* stream)
     AiLoaderIOStream *s = static_cast<AiLoaderIOStream*>(stream);
     Q_ASSERT(s);
     s->device()->close();
+    // the stream is ours to free, it owns the device
+    delete s;
 }
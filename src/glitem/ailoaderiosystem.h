@@ -42,6 +42,7 @@
 #ifndef AILOADERIOSYSTEM_H
 #define AILOADERIOSYSTEM_H
 
+#include <QtGlobal>
 #include <assimp/IOSystem.hpp>
 
 class AiLoaderIOSystem : public Assimp::IOSystem
@@ -53,6 +54,22 @@ public:
     virtual char getOsSeparator() const;
     virtual Assimp::IOStream* Open(const char* pFile, const char* pMode = "rb");
     virtual void Close(Assimp::IOStream* pFile);
+
+    // IO done by the streams of this system
+    int openCount() const { return m_open_count; }
+    qint64 readCount() const { return m_read_count; }
+    qint64 readBytes() const { return m_read_bytes; }
+    qint64 mappedBytes() const { return m_mapped_bytes; }
+    qint64 preloadedBytes() const { return m_preloaded_bytes; }
+
+private:
+    friend class AiLoaderIOStream;
+
+    int m_open_count;
+    qint64 m_read_count;
+    qint64 m_read_bytes;
+    qint64 m_mapped_bytes;
+    qint64 m_preloaded_bytes;
 };
 
 #endif // AILOADERIOSYSTEM_H
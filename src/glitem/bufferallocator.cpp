@@ -0,0 +1,68 @@
+#include "bufferallocator.h"
+
+
+int BufferAllocator::largestFree() const
+{
+    int largest = 0;
+    for (QMap<int, int>::const_iterator it = m_free.begin(); it != m_free.end(); ++it)
+        largest = qMax(largest, it.value());
+    return largest;
+}
+
+void BufferAllocator::reset(int capacity)
+{
+    m_capacity = capacity;
+    m_used = 0;
+    m_free.clear();
+    if (capacity > 0)
+        m_free.insert(0, capacity);
+}
+
+int BufferAllocator::allocate(int size)
+{
+    if (size <= 0)
+        return 0;
+
+    for (QMap<int, int>::iterator it = m_free.begin(); it != m_free.end(); ++it) {
+        if (it.value() < size)
+            continue;
+
+        int offset = it.key();
+        int left = it.value() - size;
+        m_free.erase(it);
+        if (left)
+            m_free.insert(offset + size, left);
+
+        m_used += size;
+        return offset;
+    }
+    return -1;
+}
+
+void BufferAllocator::free(int offset, int size)
+{
+    if (size <= 0)
+        return;
+
+    Q_ASSERT(offset >= 0 && offset + size <= m_capacity);
+    m_used -= size;
+
+    // merge with the free range that follows
+    QMap<int, int>::iterator next = m_free.find(offset + size);
+    if (next != m_free.end()) {
+        size += next.value();
+        m_free.erase(next);
+    }
+
+    // and with the one that ends right before
+    QMap<int, int>::iterator it = m_free.lowerBound(offset);
+    if (it != m_free.begin()) {
+        --it;
+        if (it.key() + it.value() == offset) {
+            it.value() += size;
+            return;
+        }
+    }
+
+    m_free.insert(offset, size);
+}
@@ -0,0 +1,33 @@
+#ifndef BUFFERALLOCATOR_H
+#define BUFFERALLOCATOR_H
+
+#include <QMap>
+
+// Ranges of a GPU buffer handed out first fit from a free list, in
+// elements of the buffer rather than bytes. Freed ranges are merged
+// with their free neighbours, the owner packs the live ranges into a
+// new buffer when no free range is large enough.
+class BufferAllocator
+{
+public:
+    BufferAllocator() : m_capacity(0), m_used(0) {}
+
+    int capacity() const { return m_capacity; }
+    int used() const { return m_used; }
+    int largestFree() const;
+
+    // forget all ranges, the whole capacity becomes one free range
+    void reset(int capacity);
+
+    // offset of a range of size, -1 when no free range is large enough
+    int allocate(int size);
+    void free(int offset, int size);
+
+private:
+    int m_capacity;
+    int m_used;
+    // offset to size of the free ranges
+    QMap<int, int> m_free;
+};
+
+#endif // BUFFERALLOCATOR_H
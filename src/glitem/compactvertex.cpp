@@ -0,0 +1,119 @@
+#include "compactvertex.h"
+#include "geometry.h"
+#include <qmath.h>
+
+
+static void bounds(const Geometry &geometry, QVector3D &center, QVector3D &extent)
+{
+    const Vertex *vertex = geometry.vertices();
+    if (!geometry.vertexCount()) {
+        center = QVector3D();
+        extent = QVector3D(1, 1, 1);
+        return;
+    }
+
+    float low[3], high[3];
+    for (int j = 0; j < 3; j++)
+        low[j] = high[j] = vertex[0].position[j];
+
+    for (int i = 1; i < geometry.vertexCount(); i++) {
+        for (int j = 0; j < 3; j++) {
+            low[j] = qMin(low[j], vertex[i].position[j]);
+            high[j] = qMax(high[j], vertex[i].position[j]);
+        }
+    }
+
+    for (int j = 0; j < 3; j++) {
+        center[j] = (low[j] + high[j]) / 2;
+        // flat models still need a usable scale
+        extent[j] = high[j] > low[j] ? (high[j] - low[j]) / 2 : 1;
+    }
+}
+
+static qint16 toSnorm16(float value)
+{
+    return qint16(qRound(qBound(-1.0f, value, 1.0f) * 32767));
+}
+
+static quint16 toHalf(float value)
+{
+    union { float f; quint32 u; } v;
+    v.f = value;
+
+    quint32 sign = (v.u >> 16) & 0x8000;
+    int exponent = int((v.u >> 23) & 0xff) - 127 + 15;
+    quint32 mantissa = v.u & 0x7fffff;
+
+    if (((v.u >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    if (exponent <= 0) {
+        // denormal half, or zero when too small
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        quint32 half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+        return sign | half;
+    }
+
+    // rounding may carry into the exponent, which is still correct
+    quint32 half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000)
+        half++;
+    return half;
+}
+
+QMatrix4x4 CompactVertex::dequantizeMatrix(const Geometry &geometry)
+{
+    QVector3D center, extent;
+    bounds(geometry, center, extent);
+
+    QMatrix4x4 matrix;
+    matrix.translate(center);
+    matrix.scale(extent);
+    return matrix;
+}
+
+void CompactVertex::pack(const Geometry &geometry, CompactVertex *out)
+{
+    pack(geometry.vertices(), geometry.vertexCount(), dequantizeMatrix(geometry), out);
+}
+
+void CompactVertex::pack(const Vertex *vertex, int count, const QMatrix4x4 &dequantize, CompactVertex *out)
+{
+    QVector3D center = dequantize.column(3).toVector3D();
+    QVector3D extent(dequantize(0, 0), dequantize(1, 1), dequantize(2, 2));
+
+    for (int i = 0; i < count; i++) {
+        const Vertex &v = vertex[i];
+        CompactVertex &c = out[i];
+
+        for (int j = 0; j < 3; j++)
+            c.position[j] = toSnorm16((v.position[j] - center[j]) / extent[j]);
+        c.position[3] = 0;
+
+        // project the normal on the octahedron and unfold the lower half
+        float x = v.normal[0], y = v.normal[1], z = v.normal[2];
+        float l1 = qAbs(x) + qAbs(y) + qAbs(z);
+        if (l1 > 0) {
+            x /= l1;
+            y /= l1;
+        }
+        if (z < 0) {
+            float ox = (1 - qAbs(y)) * (x >= 0 ? 1 : -1);
+            float oy = (1 - qAbs(x)) * (y >= 0 ? 1 : -1);
+            x = ox;
+            y = oy;
+        }
+        c.normal[0] = toSnorm16(x);
+        c.normal[1] = toSnorm16(y);
+
+        c.uv[0] = toHalf(v.uv[0]);
+        c.uv[1] = toHalf(v.uv[1]);
+    }
+}
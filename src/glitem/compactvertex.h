@@ -0,0 +1,24 @@
+#ifndef COMPACTVERTEX_H
+#define COMPACTVERTEX_H
+
+#include <QMatrix4x4>
+
+class Geometry;
+struct Vertex;
+
+// Half size vertex layout: positions are 16-bit normalized to the
+// model bounds, normals are octahedral encoded and uvs half floats.
+struct CompactVertex {
+    qint16 position[4];
+    qint16 normal[2];
+    quint16 uv[2];
+
+    // maps the normalized positions of geometry back to model space
+    static QMatrix4x4 dequantizeMatrix(const Geometry &geometry);
+    static void pack(const Geometry &geometry, CompactVertex *out);
+    // pack vertices against bounds given by a dequantizeMatrix(), positions
+    // outside of them are clamped
+    static void pack(const Vertex *vertex, int count, const QMatrix4x4 &dequantize, CompactVertex *out);
+};
+
+#endif // COMPACTVERTEX_H
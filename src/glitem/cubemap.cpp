@@ -0,0 +1,109 @@
+#include "cubemap.h"
+#include <qmath.h>
+
+
+CubeMap::Layout CubeMap::layout(const QSize &size)
+{
+    int w = size.width(), h = size.height();
+    if (w * 3 == h * 4 && w % 4 == 0)
+        return HorizontalCross;
+    if (w * 4 == h * 3 && w % 3 == 0)
+        return VerticalCross;
+    if (w == h * 2)
+        return Equirectangular;
+    return Unknown;
+}
+
+int CubeMap::faceSize(const QSize &size, Layout layout)
+{
+    switch (layout) {
+    case HorizontalCross:
+        return size.width() / 4;
+    case VerticalCross:
+        return size.width() / 3;
+    case Equirectangular:
+        // a face spans a quarter of the longitudes
+        return size.width() / 4;
+    default:
+        return 0;
+    }
+}
+
+QImage CubeMap::face(const QImage &image, Layout layout, int face)
+{
+    if (layout == Equirectangular)
+        return equirectangularFace(image, face);
+    return crossFace(image, layout, face);
+}
+
+QImage CubeMap::crossFace(const QImage &image, Layout layout, int face)
+{
+    // cell of each face in GL order
+    static const int horizontal[6][2] = {
+        {2, 1}, {0, 1}, {1, 0}, {1, 2}, {3, 1}, {1, 1}
+    };
+    static const int vertical[6][2] = {
+        {2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 3}, {1, 1}
+    };
+
+    int size = faceSize(image.size(), layout);
+    const int *cell = layout == HorizontalCross ? horizontal[face] : vertical[face];
+    QImage result = image.copy(cell[0] * size, cell[1] * size, size, size)
+                         .convertToFormat(QImage::Format_RGBA8888);
+
+    // the back face hangs below the bottom one
+    if (layout == VerticalCross && face == 4)
+        result = result.mirrored(true, true);
+    return result;
+}
+
+QImage CubeMap::equirectangularFace(const QImage &image, int face)
+{
+    QImage source = image.format() == QImage::Format_RGBA8888 ?
+                    image : image.convertToFormat(QImage::Format_RGBA8888);
+    int size = faceSize(image.size(), Equirectangular);
+    int width = source.width(), height = source.height();
+    QImage result(size, size, QImage::Format_RGBA8888);
+
+    for (int j = 0; j < size; j++) {
+        uchar *out = result.scanLine(j);
+        float tc = 2.0f * (j + 0.5f) / size - 1.0f;
+
+        for (int i = 0; i < size; i++, out += 4) {
+            float sc = 2.0f * (i + 0.5f) / size - 1.0f;
+
+            // direction of the texel, per the GL cube map face selection
+            float x, y, z;
+            switch (face) {
+            case 0: x = 1; y = -tc; z = -sc; break;
+            case 1: x = -1; y = -tc; z = sc; break;
+            case 2: x = sc; y = 1; z = tc; break;
+            case 3: x = sc; y = -1; z = -tc; break;
+            case 4: x = sc; y = -tc; z = 1; break;
+            default: x = -sc; y = -tc; z = -1; break;
+            }
+
+            float len = qSqrt(x * x + y * y + z * z);
+            float u = (qAtan2(x, -z) / (2 * M_PI) + 0.5f) * width - 0.5f;
+            float v = qAcos(y / len) / M_PI * height - 0.5f;
+
+            // bilinear, wrapping around in longitude
+            int u0 = qFloor(u), v0 = qFloor(v);
+            float fu = u - u0, fv = v - v0;
+            int u1 = (u0 + 1) % width;
+            u0 = (u0 + width) % width;
+            int v1 = qMin(v0 + 1, height - 1);
+            v0 = qMax(v0, 0);
+
+            const uchar *r0 = source.constScanLine(v0);
+            const uchar *r1 = source.constScanLine(v1);
+            for (int c = 0; c < 4; c++) {
+                float top = r0[u0 * 4 + c] * (1 - fu) + r0[u1 * 4 + c] * fu;
+                float bottom = r1[u0 * 4 + c] * (1 - fu) + r1[u1 * 4 + c] * fu;
+                out[c] = uchar(top * (1 - fv) + bottom * fv + 0.5f);
+            }
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef CUBEMAP_H
+#define CUBEMAP_H
+
+#include <QImage>
+
+// Faces of a cube map cut out of a single image, in GL face order
+// +x -x +y -y +z -z which are the right, left, top, bottom, back and
+// front faces of GLEnvironment.
+class CubeMap
+{
+public:
+    enum Layout {
+        Unknown,
+        // 4x3 faces: top, then left front right back, then bottom
+        HorizontalCross,
+        // 3x4 faces: top, then left front right, bottom, back upside down
+        VerticalCross,
+        // 2:1 longitude latitude, front at the center
+        Equirectangular
+    };
+
+    static Layout layout(const QSize &size);
+    static int faceSize(const QSize &size, Layout layout);
+
+    // one RGBA8888 face of image, safe to run for all faces at once
+    static QImage face(const QImage &image, Layout layout, int face);
+
+private:
+    static QImage crossFace(const QImage &image, Layout layout, int face);
+    static QImage equirectangularFace(const QImage &image, int face);
+};
+
+#endif // CUBEMAP_H
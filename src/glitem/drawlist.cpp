@@ -0,0 +1,149 @@
+#include "drawlist.h"
+#include "glnode.h"
+#include "material.h"
+
+
+void DrawList::build(GLTransformNode *root, const QList<GLShader *> &shaders)
+{
+    // materials and texture sets numbered in the order they are met
+    QHash<Material *, int> materials;
+    QHash<QPair<QOpenGLTexture *, QOpenGLTexture *>, int> textures;
+
+    m_draws.clear();
+    if (root)
+        collect(root, shaders, materials, textures);
+
+    m_dirty = false;
+}
+
+void DrawList::collect(GLTransformNode *node, const QList<GLShader *> &shaders,
+                       QHash<Material *, int> &materials,
+                       QHash<QPair<QOpenGLTexture *, QOpenGLTexture *>, int> &textures)
+{
+    if (!node->visible())
+        return;
+
+    foreach (GLRenderNode *rnode, node->renderChildren()) {
+        Material *material = rnode->material();
+        if (!rnode->visible() || !material)
+            continue;
+
+        int shader = shaders.indexOf(material->shader());
+        if (shader < 0)
+            continue;
+
+        QHash<Material *, int>::iterator mit = materials.find(material);
+        if (mit == materials.end())
+            mit = materials.insert(material, materials.size());
+
+        QPair<QOpenGLTexture *, QOpenGLTexture *> set = material->textureSet();
+        QHash<QPair<QOpenGLTexture *, QOpenGLTexture *>, int>::iterator tit = textures.find(set);
+        if (tit == textures.end())
+            tit = textures.insert(set, textures.size());
+
+        quint64 shader_bits = shader & 0x7f;
+        quint64 texture_bits = tit.value() & 0xffff;
+        quint64 material_bits = mit.value() & 0xffff;
+
+        Draw draw;
+        draw.tnode = node;
+        draw.rnode = rnode;
+        draw.mesh = rnode->mesh();
+        draw.material = material;
+        draw.shader = material->shader();
+        if (material->transparent())
+            draw.key = (quint64(1) << 63) | (shader_bits << 32) |
+                       (texture_bits << 16) | material_bits;
+        else
+            draw.key = (shader_bits << 56) | (texture_bits << 40) | (material_bits << 24);
+        m_draws.append(draw);
+    }
+
+    foreach (GLTransformNode *tnode, node->transformChildren()) {
+        collect(tnode, shaders, materials, textures);
+    }
+}
+
+// distance of a node's origin in front of the camera, as 24 bits that
+// order like the distance, positive floats order like their bits
+static quint64 depthBits(GLTransformNode *node)
+{
+    float z = -node->modelviewMatrix()(2, 3);
+    if (!(z > 0))
+        z = 0;
+
+    union { float f; quint32 u; } v;
+    v.f = z;
+    return v.u >> 7;
+}
+
+// stable LSD radix sort on bytes, skipping bytes all keys share
+static void radixSort(QVector<quint64> &keys, QVector<int> &order,
+                      QVector<quint64> &keys_tmp, QVector<int> &order_tmp)
+{
+    int n = keys.size();
+    keys_tmp.resize(n);
+    order_tmp.resize(n);
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        int count[256] = { 0 };
+        for (int i = 0; i < n; i++)
+            count[(keys[i] >> shift) & 0xff]++;
+        if (count[(keys[0] >> shift) & 0xff] == n)
+            continue;
+
+        int sum = 0;
+        for (int d = 0; d < 256; d++) {
+            int c = count[d];
+            count[d] = sum;
+            sum += c;
+        }
+
+        for (int i = 0; i < n; i++) {
+            int j = count[(keys[i] >> shift) & 0xff]++;
+            keys_tmp[j] = keys[i];
+            order_tmp[j] = order[i];
+        }
+        keys.swap(keys_tmp);
+        order.swap(order_tmp);
+    }
+}
+
+void DrawList::sort()
+{
+    int n = m_draws.size();
+    m_keys.resize(n);
+    m_order.resize(n);
+    for (int i = 0; i < n; i++) {
+        const Draw &draw = m_draws[i];
+        quint64 depth = depthBits(draw.tnode);
+        if (draw.key >> 63)
+            m_keys[i] = draw.key | ((~depth & 0xffffff) << 39);
+        else
+            m_keys[i] = draw.key | depth;
+        m_order[i] = i;
+    }
+
+    if (n)
+        radixSort(m_keys, m_order, m_keys_tmp, m_order_tmp);
+
+    m_sorted.resize(n);
+    m_batches.clear();
+    for (int i = 0; i < n; i++) {
+        const Draw &draw = m_draws[m_order[i]];
+        m_sorted[i] = draw;
+
+        bool blend = m_keys[i] >> 63;
+        if (m_batches.isEmpty() ||
+            m_batches.last().shader != draw.shader ||
+            m_batches.last().blend != blend) {
+            Batch batch;
+            batch.shader = draw.shader;
+            batch.blend = blend;
+            batch.first = i;
+            batch.count = 0;
+            m_batches.append(batch);
+        }
+        m_batches.last().count++;
+    }
+}
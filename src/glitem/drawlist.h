@@ -0,0 +1,76 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QPair>
+
+class QOpenGLTexture;
+class GLShader;
+class GLTransformNode;
+class GLRenderNode;
+class Material;
+class Mesh;
+
+// Visible draws of a scene, collected with one walk of the node tree
+// after the scene, node visibility or materials change, and sorted each
+// frame by a 64-bit key so draws sharing a shader, textures and material
+// are next to each other:
+//
+//   opaque   0 | shader 7 | textures 16 | material 16 | depth 24
+//   blended  1 | far to near depth 24 | shader 7 | textures 16 | material 16
+//
+// Opaque draws go near to far after state, blended ones far to near
+// before it so they composite correctly.
+class DrawList
+{
+public:
+    struct Draw {
+        GLTransformNode *tnode;
+        GLRenderNode *rnode;
+        Mesh *mesh;
+        Material *material;
+        GLShader *shader;
+        // state part of the sort key, depth is added each frame
+        quint64 key;
+    };
+
+    // sorted draws of one shader in one pass
+    struct Batch {
+        GLShader *shader;
+        bool blend;
+        int first;
+        int count;
+    };
+
+    DrawList() : m_dirty(true) {}
+
+    bool isDirty() const { return m_dirty; }
+    void invalidate() { m_dirty = true; }
+
+    void build(GLTransformNode *root, const QList<GLShader *> &shaders);
+    // order the draws for the current modelview matrices
+    void sort();
+
+    const QVector<Draw> &draws() const { return m_sorted; }
+    const QList<Batch> &batches() const { return m_batches; }
+
+private:
+    bool m_dirty;
+    QVector<Draw> m_draws;
+    QVector<Draw> m_sorted;
+    QList<Batch> m_batches;
+
+    // sort buffers, kept to not allocate each frame
+    QVector<quint64> m_keys;
+    QVector<quint64> m_keys_tmp;
+    QVector<int> m_order;
+    QVector<int> m_order_tmp;
+
+    void collect(GLTransformNode *node, const QList<GLShader *> &shaders,
+                 QHash<Material *, int> &materials,
+                 QHash<QPair<QOpenGLTexture *, QOpenGLTexture *>, int> &textures);
+};
+
+#endif // DRAWLIST_H
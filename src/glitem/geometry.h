@@ -0,0 +1,68 @@
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include <QVector>
+
+struct Vertex {
+    float position[3];
+    float normal[3];
+    float uv[2];
+};
+
+// Packed vertex and index arrays a model is loaded into, the scene
+// buffers are uploaded straight from here without another copy.
+class Geometry
+{
+public:
+    void reserve(int nvertex, int nindex) {
+        m_vertices.reserve(nvertex);
+        m_indices.reserve(nindex);
+    }
+
+    Vertex &addVertex() {
+        m_vertices.append(Vertex());
+        return m_vertices.last();
+    }
+
+    // append n zeroed vertices for the loader to fill in
+    Vertex *addVertices(int n) {
+        int size = m_vertices.size();
+        m_vertices.resize(size + n);
+        return m_vertices.data() + size;
+    }
+
+    uint *addIndices(int n) {
+        int size = m_indices.size();
+        m_indices.resize(size + n);
+        return m_indices.data() + size;
+    }
+
+    void addTriangle(uint a, uint b, uint c) {
+        m_indices.append(a);
+        m_indices.append(b);
+        m_indices.append(c);
+    }
+
+    Vertex *vertices() { return m_vertices.data(); }
+    uint *indices() { return m_indices.data(); }
+    const Vertex *vertices() const { return m_vertices.constData(); }
+    const uint *indices() const { return m_indices.constData(); }
+    int vertexCount() const { return m_vertices.size(); }
+    int indexCount() const { return m_indices.size(); }
+
+    QVector<Vertex> &vertexArray() { return m_vertices; }
+    QVector<uint> &indexArray() { return m_indices; }
+    const QVector<Vertex> &vertexArray() const { return m_vertices; }
+    const QVector<uint> &indexArray() const { return m_indices; }
+
+    void clear() {
+        m_vertices.clear();
+        m_indices.clear();
+    }
+
+private:
+    QVector<Vertex> m_vertices;
+    QVector<uint> m_indices;
+};
+
+#endif // GEOMETRY_H
@@ -3,8 +3,9 @@
 
 
 GLAnimateNode::GLAnimateNode(QObject *parent) :
-    QObject(parent)
+    QObject(parent), m_dirty(true)
 {
+    connect(this, &GLAnimateNode::transformChanged, this, &GLAnimateNode::setDirty);
 }
 
 QQmlListProperty<GLTransform> GLAnimateNode::transform()
@@ -74,3 +75,9 @@ void GLAnimateNode::applyTo(QMatrix4x4 *matrix)
     for (int i = 0; i < m_transforms.size(); i++)
         m_transforms[i]->applyTo(matrix);
 }
+
+void GLAnimateNode::applyTo(Affine3x4 *matrix)
+{
+    for (int i = 0; i < m_transforms.size(); i++)
+        m_transforms[i]->applyToAffine(matrix);
+}
@@ -5,6 +5,7 @@
 #include <QQmlListProperty>
 
 class GLTransform;
+struct Affine3x4;
 
 class GLAnimateNode : public QObject
 {
@@ -14,6 +15,11 @@ class GLAnimateNode : public QObject
 public:
     GLAnimateNode(QObject *parent = 0);
     void applyTo(QMatrix4x4 *matrix);
+    void applyTo(Affine3x4 *matrix);
+
+    // transforms changed since the render last took the flag
+    bool isDirty() const { return m_dirty; }
+    void setClean() { m_dirty = false; }
 
     QQmlListProperty<GLTransform> transform();
     QString name() { return m_name; }
@@ -22,8 +28,12 @@ public:
 signals:
     void transformChanged();
 
+private slots:
+    void setDirty() { m_dirty = true; }
+
 private:
     QString m_name;
+    bool m_dirty;
 
     static int transform_count(QQmlListProperty<GLTransform> *list);
     static void transform_append(QQmlListProperty<GLTransform> *list, GLTransform *);
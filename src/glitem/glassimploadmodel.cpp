@@ -3,14 +3,17 @@
 #include "material.h"
 #include "light.h"
 #include "ailoaderiosystem.h"
+#include "modelcache.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <QOpenGLTexture>
+#include <QElapsedTimer>
 #include <QDebug>
 
 GLAssimpLoadModel::GLAssimpLoadModel(QObject *parent)
-    : GLModel(parent), m_ignore_light(false), m_scene(0)
+    : GLModel(parent), m_ignore_light(false), m_cache(true),
+      m_import_profile("default"), m_scene(0)
 {
 
 }
@@ -36,20 +39,213 @@ void GLAssimpLoadModel::setIgnoreLight(bool value)
     }
 }
 
+void GLAssimpLoadModel::setCache(bool value)
+{
+    if (m_cache != value) {
+        m_cache = value;
+        emit cacheChanged();
+    }
+}
+
+void GLAssimpLoadModel::setImportProfile(const QString &value)
+{
+    if (m_import_profile != value) {
+        m_import_profile = value;
+        emit importProfileChanged();
+    }
+}
+
+void GLAssimpLoadModel::setImportFlags(const QStringList &value)
+{
+    if (m_import_flags != value) {
+        m_import_flags = value;
+        emit importFlagsChanged();
+    }
+}
+
+uint GLAssimpLoadModel::postProcessFlags()
+{
+    static const struct {
+        const char *name;
+        uint flag;
+    } steps[] = {
+        { "CalcTangentSpace", aiProcess_CalcTangentSpace },
+        { "JoinIdenticalVertices", aiProcess_JoinIdenticalVertices },
+        { "MakeLeftHanded", aiProcess_MakeLeftHanded },
+        { "Triangulate", aiProcess_Triangulate },
+        { "RemoveComponent", aiProcess_RemoveComponent },
+        { "GenNormals", aiProcess_GenNormals },
+        { "GenSmoothNormals", aiProcess_GenSmoothNormals },
+        { "SplitLargeMeshes", aiProcess_SplitLargeMeshes },
+        { "PreTransformVertices", aiProcess_PreTransformVertices },
+        { "LimitBoneWeights", aiProcess_LimitBoneWeights },
+        { "ValidateDataStructure", aiProcess_ValidateDataStructure },
+        { "ImproveCacheLocality", aiProcess_ImproveCacheLocality },
+        { "RemoveRedundantMaterials", aiProcess_RemoveRedundantMaterials },
+        { "FixInfacingNormals", aiProcess_FixInfacingNormals },
+        { "SortByPType", aiProcess_SortByPType },
+        { "FindDegenerates", aiProcess_FindDegenerates },
+        { "FindInvalidData", aiProcess_FindInvalidData },
+        { "GenUVCoords", aiProcess_GenUVCoords },
+        { "TransformUVCoords", aiProcess_TransformUVCoords },
+        { "FindInstances", aiProcess_FindInstances },
+        { "OptimizeMeshes", aiProcess_OptimizeMeshes },
+        { "OptimizeGraph", aiProcess_OptimizeGraph },
+        { "FlipUVs", aiProcess_FlipUVs },
+        { "FlipWindingOrder", aiProcess_FlipWindingOrder }
+    };
+
+    // the loader only takes triangles with normals
+    uint flags = aiProcess_Triangulate | aiProcess_SortByPType;
+
+    if (!m_import_flags.isEmpty()) {
+        foreach (const QString &name, m_import_flags) {
+            uint i;
+            for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++) {
+                if (name == steps[i].name) {
+                    flags |= steps[i].flag;
+                    break;
+                }
+            }
+            if (i == sizeof(steps) / sizeof(steps[0]))
+                qWarning() << "unknown assimp import flag: " << name;
+        }
+        // assimp refuses both normal generation steps together
+        if (!(flags & aiProcess_GenSmoothNormals))
+            flags |= aiProcess_GenNormals;
+        return flags;
+    }
+
+    flags |= aiProcess_GenNormals;
+    if (m_import_profile == "fastImport")
+        return flags;
+
+    flags |= aiProcess_JoinIdenticalVertices;
+    if (m_import_profile == "runtimeFast")
+        return flags |
+               aiProcess_ImproveCacheLocality |
+               aiProcess_RemoveRedundantMaterials |
+               aiProcess_OptimizeMeshes |
+               aiProcess_OptimizeGraph |
+               aiProcess_FindInstances;
+
+    if (m_import_profile != "default")
+        qWarning() << "unknown assimp import profile: " << m_import_profile;
+    return flags;
+}
+
 bool GLAssimpLoadModel::load()
 {
     QString path;
     if (!urlToPath(m_file, path))
         return false;
 
+    QElapsedTimer timer;
+    timer.start();
+
+    m_model_dir.setPath(path);
+    m_model_dir.cdUp();
+
+    if (name().isEmpty())
+        setName(m_file.fileName());
+
+    // each set of post-process steps and the optimized geometry
+    // are cached apart
+    uint flags = postProcessFlags();
+    QString tag = QString("assimp-%1").arg(flags, 0, 16);
+    if (optimize())
+        tag += "-optimized";
+
+    bool loading;
+    QSharedPointer<SharedScene> shared =
+            SharedModel::acquire<SharedScene>(SharedModel::key(path, tag), loading);
+
+    bool cached = false;
+    if (!loading) {
+        // another model imports the same file
+        if (!shared->wait()) {
+            shared->releaseGeometry();
+            return false;
+        }
+        m_geometry = shared->geometry;
+        m_meshes = shared->meshes;
+        m_material_info = shared->material_info;
+        m_node_info = shared->node_info;
+        m_light_info = shared->light_info;
+        m_mesh_material = shared->mesh_material;
+    }
+    else {
+        ModelCache cache(path, tag);
+        cached = m_cache && cache.open() && readSceneCache(cache);
+        if (!cached) {
+            release();
+            m_meshes.clear();
+            m_material_info.clear();
+            m_node_info.clear();
+            m_light_info.clear();
+            m_mesh_material.clear();
+
+            if (!importScene(path, flags)) {
+                shared->finish(false);
+                shared->releaseGeometry();
+                return false;
+            }
+
+            if (m_cache && cache.create()) {
+                writeSceneCache(cache);
+                cache.commit();
+            }
+        }
+
+        shared->geometry = m_geometry;
+        shared->meshes = m_meshes;
+        shared->material_info = m_material_info;
+        shared->node_info = m_node_info;
+        shared->light_info = m_light_info;
+        shared->mesh_material = m_mesh_material;
+        shared->finish(true);
+    }
+    m_shared = shared;
+
+    if (!m_material)
+        loadMaterial();
+
+    int index = 0;
+    m_root = loadNode(index);
+
+    if (!m_ignore_light)
+        loadLight();
+
+    int draws = 0;
+    foreach (const NodeInfo &info, m_node_info) {
+        draws += info.meshes.size();
+    }
+    qDebug() << "model" << name() << "profile"
+             << (m_import_flags.isEmpty() ? m_import_profile : m_import_flags.join('|'))
+             << (!loading ? "shared" : cached ? "from cache" : "imported")
+             << "in" << timer.elapsed() << "ms,"
+             << m_meshes.size() << "meshes," << draws << "draws,"
+             << m_geometry.vertexCount() << "vertices";
+
+    m_material_info.clear();
+    m_node_info.clear();
+    m_light_info.clear();
+    m_mesh_material.clear();
+
+    return GLModel::load();
+}
+
+bool GLAssimpLoadModel::importScene(const QString &path, uint flags)
+{
     Assimp::Importer importer;
-    importer.SetIOHandler(new AiLoaderIOSystem());
+    AiLoaderIOSystem *io = new AiLoaderIOSystem();
+    importer.SetIOHandler(io);
 
-    m_scene = importer.ReadFile(path.toStdString(),
-                       aiProcess_CalcTangentSpace       |
-                       aiProcess_Triangulate            |
-                       aiProcess_JoinIdenticalVertices  |
-                       aiProcess_SortByPType);
+    m_scene = importer.ReadFile(path.toStdString(), flags);
+
+    qDebug() << "model" << name() << "assimp io:" << io->openCount() << "files,"
+             << io->mappedBytes() << "bytes mapped," << io->preloadedBytes() << "bytes preloaded,"
+             << io->readCount() << "reads of" << io->readBytes() << "bytes";
     if (!m_scene) {
         qWarning() << "load file " << m_file << " fail: " << importer.GetErrorString();
         return false;
@@ -75,106 +271,78 @@ bool GLAssimpLoadModel::load()
 
     printNode(m_scene->mRootNode, "  ");
 
-    m_model_dir.setPath(path);
-    m_model_dir.cdUp();
-
-    loadPrimitive();
-
-    if (!m_material)
-        loadMaterial();
+    readPrimitive();
+    optimizeGeometry();
 
-    m_root = loadNode(m_scene->mRootNode);
-
-    if (!m_ignore_light)
-        loadLight();
+    readMaterial();
+    readNode(m_scene->mRootNode);
+    readLight();
 
     m_scene = NULL;
-
-    if (name().isEmpty())
-        setName(m_file.fileName());
-
-    return GLModel::load();
+    return true;
 }
 
-void GLAssimpLoadModel::loadPrimitive()
+void GLAssimpLoadModel::readPrimitive()
 {
-    uint np = 0, ntp = 0, nf = 0, ntf = 0;
+    uint np = 0, nf = 0;
     for (uint i = 0; i < m_scene->mNumMeshes; i++) {
         aiMesh *mesh = m_scene->mMeshes[i];
-        if (mesh->HasNormals()) {
-            if (mesh->HasTextureCoords(0)) {
-                ntp += mesh->mNumVertices;
-                ntf += mesh->mNumFaces;
-            }
-            else {
-                np += mesh->mNumVertices;
-                nf += mesh->mNumFaces;
-            }
-        }
+        np += mesh->mNumVertices;
+        nf += mesh->mNumFaces;
     }
 
-    m_vertex.reserve(np * 6);
-    m_index.reserve(nf * 3);
-    m_textured_vertex.reserve(ntp * 6);
-    m_textured_vertex_uv.reserve(ntp * 2);
-    m_textured_index.reserve(ntf * 3);
+    m_geometry.reserve(np, nf * 3);
 
     m_meshes.resize(m_scene->mNumMeshes);
+    m_mesh_material.resize(m_scene->mNumMeshes);
 
     for (uint i = 0; i < m_scene->mNumMeshes; i++) {
         aiMesh *mesh = m_scene->mMeshes[i];
         Q_ASSERT(mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE);
         Q_ASSERT(mesh->HasNormals());
 
-        QList<float> *va;
-        QList<ushort> *ia;
-        if (mesh->HasTextureCoords(0)) {
-            m_meshes[i].type = Mesh::TEXTURED;
-            va = &m_textured_vertex;
-            ia = &m_textured_index;
+        bool textured = mesh->HasTextureCoords(0);
+        m_meshes[i].type = textured ? Mesh::TEXTURED : Mesh::NORMAL;
+        m_mesh_material[i] = mesh->mMaterialIndex;
 
-            for (uint j = 0; j < mesh->mNumVertices; j++) {
-                m_textured_vertex_uv.append(mesh->mTextureCoords[0][j].x);
-                m_textured_vertex_uv.append(mesh->mTextureCoords[0][j].y);
-            }
-        }
-        else {
-            m_meshes[i].type = Mesh::NORMAL;
-            va = &m_vertex;
-            ia = &m_index;
-        }
-
-        int ibase = va->size() / 6;
-        m_meshes[i].index_offset = ia->size() * sizeof(ushort);
+        uint ibase = m_geometry.vertexCount();
+        m_meshes[i].index_offset = m_geometry.indexCount();
         m_meshes[i].index_count = mesh->mNumFaces * 3;
 
+        Vertex *vertex = m_geometry.addVertices(mesh->mNumVertices);
         for (uint j = 0; j < mesh->mNumVertices; j++) {
-            va->append(mesh->mVertices[j].x);
-            va->append(mesh->mVertices[j].y);
-            va->append(mesh->mVertices[j].z);
+            vertex[j].position[0] = mesh->mVertices[j].x;
+            vertex[j].position[1] = mesh->mVertices[j].y;
+            vertex[j].position[2] = mesh->mVertices[j].z;
+
+            vertex[j].normal[0] = mesh->mNormals[j].x;
+            vertex[j].normal[1] = mesh->mNormals[j].y;
+            vertex[j].normal[2] = mesh->mNormals[j].z;
 
-            va->append(mesh->mNormals[j].x);
-            va->append(mesh->mNormals[j].y);
-            va->append(mesh->mNormals[j].z);
+            if (textured) {
+                vertex[j].uv[0] = mesh->mTextureCoords[0][j].x;
+                vertex[j].uv[1] = mesh->mTextureCoords[0][j].y;
+            }
         }
 
+        uint *index = m_geometry.addIndices(mesh->mNumFaces * 3);
         aiFace *faces = mesh->mFaces;
         for (uint j = 0; j < mesh->mNumFaces; j++) {
             Q_ASSERT(faces[j].mNumIndices == 3);
-            ia->append(faces[j].mIndices[0] + ibase);
-            ia->append(faces[j].mIndices[1] + ibase);
-            ia->append(faces[j].mIndices[2] + ibase);
+            *index++ = faces[j].mIndices[0] + ibase;
+            *index++ = faces[j].mIndices[1] + ibase;
+            *index++ = faces[j].mIndices[2] + ibase;
         }
     }
 }
 
-void GLAssimpLoadModel::loadMaterial()
+void GLAssimpLoadModel::readMaterial()
 {
-    if (m_scene->HasMaterials())
-        m_materials.reserve(m_scene->mNumMaterials);
+    m_material_info.resize(m_scene->mNumMaterials);
 
     for (uint i = 0; i < m_scene->mNumMaterials; i++) {
         aiMaterial *material = m_scene->mMaterials[i];
+        MaterialInfo &info = m_material_info[i];
 
         int shadingModel;
         material->Get(AI_MATKEY_SHADING_MODEL, shadingModel);
@@ -197,62 +365,45 @@ void GLAssimpLoadModel::loadMaterial()
         if (material->Get(AI_MATKEY_SHININESS, shine) != aiReturn_SUCCESS)
             qWarning("material get shine fail");
 
-        PhongMaterial *pm = new PhongMaterial;
-        loadTexture(material, aiTextureType_DIFFUSE, pm);
-        loadTexture(material, aiTextureType_SPECULAR, pm);
+        assign(info.ka, amb);
+        assign(info.kd, dif);
+        assign(info.ks, spec);
+        info.shininess = shine;
+
+        readTexture(material, aiTextureType_DIFFUSE, info.diffuse_map, info.diffuse_wrap);
+        readTexture(material, aiTextureType_SPECULAR, info.specular_map, info.specular_wrap);
+
         float reflectivity = 0.0f;
         aiColor3D cf(0.0f, 0.0f, 0.0f);
-        if (material->Get(AI_MATKEY_COLOR_REFLECTIVE, cf) == aiReturn_SUCCESS &&
-            material->Get(AI_MATKEY_REFLECTIVITY, reflectivity) == aiReturn_SUCCESS &&
-            cf != aiColor3D(0.0f, 0.0f, 0.0f)) {
-            pm->setEnvMap(reflectivity);
-        }
+        info.env_map = material->Get(AI_MATKEY_COLOR_REFLECTIVE, cf) == aiReturn_SUCCESS &&
+                       material->Get(AI_MATKEY_REFLECTIVITY, reflectivity) == aiReturn_SUCCESS &&
+                       cf != aiColor3D(0.0f, 0.0f, 0.0f);
+        info.reflectivity = reflectivity;
 
         float opacity = 1.0f;
-        if (material->Get(AI_MATKEY_OPACITY, opacity) == aiReturn_SUCCESS && opacity < 1.0f) {
-            pm->setOpacity(opacity);
-            pm->setTransparent(true);
-        }
+        if (material->Get(AI_MATKEY_OPACITY, opacity) != aiReturn_SUCCESS)
+            opacity = 1.0f;
+        info.opacity = opacity;
 
         aiString name;
         if (material->Get(AI_MATKEY_NAME, name) == aiReturn_SUCCESS)
-            pm->setName(name.C_Str());
+            info.name = name.C_Str();
         //qDebug() << "mat name" << name.C_Str();
-
-        pm->setMaterial(
-                QVector3D(amb.r, amb.g, amb.b),
-                QVector3D(dif.r, dif.g, dif.b),
-                QVector3D(spec.r, spec.g, spec.b),
-                shine);
-
-        m_materials.append(pm);
     }
 }
 
-GLTransformNode *GLAssimpLoadModel::loadNode(aiNode *node)
+void GLAssimpLoadModel::readNode(aiNode *node)
 {
-    // meaningless node for render
-    if (node->mNumChildren == 0 && node->mNumMeshes == 0)
-        return NULL;
-
-    GLTransformNode *root =
-            new GLTransformNode(node->mName.C_Str(), QMatrix4x4(node->mTransformation[0]));
-
-    for (uint i = 0; i < node->mNumMeshes; i++) {
-        GLRenderNode *rnode = new GLRenderNode(
-                    &m_meshes[node->mMeshes[i]],
-                    m_material ? 0 : m_materials[m_scene->mMeshes[node->mMeshes[i]]->mMaterialIndex]
-                );
-        root->addChild(rnode);
-    }
-
-    for (uint i = 0; i < node->mNumChildren; i++) {
-        GLTransformNode *tnode = loadNode(node->mChildren[i]);
-        if (tnode)
-            root->addChild(tnode);
-    }
+    NodeInfo info;
+    info.name = node->mName.C_Str();
+    info.transform = QMatrix4x4(node->mTransformation[0]);
+    info.children = node->mNumChildren;
+    for (uint i = 0; i < node->mNumMeshes; i++)
+        info.meshes.append(node->mMeshes[i]);
+    m_node_info.append(info);
 
-    return root;
+    for (uint i = 0; i < node->mNumChildren; i++)
+        readNode(node->mChildren[i]);
 }
 
 void GLAssimpLoadModel::assign(QVector3D &qc, const aiColor3D &ac)
@@ -269,11 +420,8 @@ void GLAssimpLoadModel::assign(QVector3D &qv, const aiVector3D &av)
     qv.setZ(av.z);
 }
 
-void GLAssimpLoadModel::loadLight()
+void GLAssimpLoadModel::readLight()
 {
-    if (m_scene->HasLights())
-        m_lights.reserve(m_scene->mNumLights);
-
     for (uint i = 0; i < m_scene->mNumLights; i++) {
         aiLight *srcLight = m_scene->mLights[i];
         aiMatrix4x4 trans;
@@ -289,69 +437,268 @@ void GLAssimpLoadModel::loadLight()
             qWarning() << "glloader: no node found for light: "
                        << srcLight->mName.C_Str();
 
-        Light *light = new Light;
+        LightInfo info;
+        Light &light = info.light;
         switch (srcLight->mType) {
         case aiLightSource_DIRECTIONAL:
-            light->type = Light::DIRECTIONAL;
-            assign(light->pos, srcLight->mDirection);
+            light.type = Light::DIRECTIONAL;
+            assign(light.pos, srcLight->mDirection);
             break;
         case aiLightSource_POINT:
-            light->type = Light::POINT;
-            assign(light->pos, srcLight->mPosition);
+            light.type = Light::POINT;
+            assign(light.pos, srcLight->mPosition);
             break;
         case aiLightSource_SPOT:
-            light->type = Light::SPOT;
+            light.type = Light::SPOT;
             break;
         default:
             continue;
         }
 
-        assign(light->dif, srcLight->mColorDiffuse);
-        assign(light->spec, srcLight->mColorSpecular);
-        light->name = srcLight->mName.C_Str();
-        light->node = new GLTransformNode(light->name, QMatrix4x4(trans[0]));
-        m_lights.append(light);
+        assign(light.dif, srcLight->mColorDiffuse);
+        assign(light.spec, srcLight->mColorSpecular);
+        light.name = srcLight->mName.C_Str();
+        info.transform = QMatrix4x4(trans[0]);
+        m_light_info.append(info);
     }
 }
 
-bool GLAssimpLoadModel::loadTexture(aiMaterial *material, aiTextureType type,
-                                    PhongMaterial *pmaterial)
+bool GLAssimpLoadModel::readTexture(aiMaterial *material, aiTextureType type,
+                                    QString &path, int &wrap)
 {
     aiString tpath;
     aiTextureMapMode mode;
     if (material->GetTextureCount(type) > 0 &&
         material->GetTexture(type, 0, &tpath, NULL, NULL, NULL, NULL, &mode)
             == aiReturn_SUCCESS) {
-        QOpenGLTexture::WrapMode wmode;
         switch (mode) {
         case aiTextureMapMode_Clamp:
-            wmode = QOpenGLTexture::ClampToEdge;
+            wrap = QOpenGLTexture::ClampToEdge;
             break;
         case aiTextureMapMode_Wrap:
-            wmode = QOpenGLTexture::Repeat;
+            wrap = QOpenGLTexture::Repeat;
             break;
         case aiTextureMapMode_Mirror:
-            wmode = QOpenGLTexture::MirroredRepeat;
+            wrap = QOpenGLTexture::MirroredRepeat;
             break;
         case aiTextureMapMode_Decal:
-            wmode = QOpenGLTexture::ClampToBorder;
+            wrap = QOpenGLTexture::ClampToBorder;
             break;
         default:
-            wmode = QOpenGLTexture::Repeat;
+            wrap = QOpenGLTexture::Repeat;
             break;
         }
 
-        QString path = m_model_dir.filePath(tpath.C_Str());
+        path = tpath.C_Str();
+        return true;
+    }
+
+    path.clear();
+    wrap = QOpenGLTexture::Repeat;
+    return false;
+}
+
+static bool readVector(ModelCache &cache, QVector3D &vector)
+{
+    float v[3];
+    if (!cache.readFloats(v, 3))
+        return false;
+    vector = QVector3D(v[0], v[1], v[2]);
+    return true;
+}
+
+static void writeVector(ModelCache &cache, const QVector3D &vector)
+{
+    float v[3] = { vector.x(), vector.y(), vector.z() };
+    cache.writeFloats(v, 3);
+}
+
+bool GLAssimpLoadModel::readSceneCache(ModelCache &cache)
+{
+    if (!readCache(cache) || !cache.read(m_mesh_material))
+        return false;
+
+    int count;
+    if (!cache.readInt(count))
+        return false;
+    m_material_info.resize(count);
+    for (int i = 0; i < count; i++) {
+        MaterialInfo &info = m_material_info[i];
+        float values[3];
+        int env_map;
+        if (!cache.readString(info.name) ||
+            !readVector(cache, info.ka) ||
+            !readVector(cache, info.kd) ||
+            !readVector(cache, info.ks) ||
+            !cache.readFloats(values, 3) ||
+            !cache.readInt(env_map) ||
+            !cache.readString(info.diffuse_map) ||
+            !cache.readInt(info.diffuse_wrap) ||
+            !cache.readString(info.specular_map) ||
+            !cache.readInt(info.specular_wrap))
+            return false;
+        info.shininess = values[0];
+        info.opacity = values[1];
+        info.reflectivity = values[2];
+        info.env_map = env_map;
+    }
+
+    if (!cache.readInt(count))
+        return false;
+    m_node_info.resize(count);
+    for (int i = 0; i < count; i++) {
+        NodeInfo &info = m_node_info[i];
+        if (!cache.readString(info.name) ||
+            !cache.readFloats(info.transform.data(), 16) ||
+            !cache.read(info.meshes) ||
+            !cache.readInt(info.children))
+            return false;
+    }
+
+    if (!cache.readInt(count))
+        return false;
+    m_light_info.resize(count);
+    for (int i = 0; i < count; i++) {
+        LightInfo &info = m_light_info[i];
+        Light &light = info.light;
+        int type;
+        if (!cache.readInt(type) ||
+            !cache.readString(light.name) ||
+            !readVector(cache, light.pos) ||
+            !readVector(cache, light.dif) ||
+            !readVector(cache, light.spec) ||
+            !cache.readFloats(info.transform.data(), 16))
+            return false;
         switch (type) {
-        case aiTextureType_DIFFUSE:
-            return pmaterial->loadDiffuseTexture(path, wmode);
-        case aiTextureType_SPECULAR:
-            return pmaterial->loadSpecularTexture(path, wmode);
+        case Light::DIRECTIONAL:
+            light.type = Light::DIRECTIONAL;
+            break;
+        case Light::SPOT:
+            light.type = Light::SPOT;
+            break;
         default:
+            light.type = Light::POINT;
+            break;
+        }
+    }
+
+    // reject caches of a newer scene layout or with dangling references
+    foreach (int material, m_mesh_material) {
+        if (material < 0 || material >= m_material_info.size())
             return false;
+    }
+    foreach (const NodeInfo &info, m_node_info) {
+        foreach (int mesh, info.meshes) {
+            if (mesh < 0 || mesh >= m_meshes.size())
+                return false;
         }
     }
-    return false;
+    return !m_node_info.isEmpty() && m_mesh_material.size() == m_meshes.size();
+}
+
+void GLAssimpLoadModel::writeSceneCache(ModelCache &cache)
+{
+    writeCache(cache);
+    cache.write(m_mesh_material);
+
+    cache.writeInt(m_material_info.size());
+    foreach (const MaterialInfo &info, m_material_info) {
+        float values[3] = { info.shininess, info.opacity, info.reflectivity };
+        cache.writeString(info.name);
+        writeVector(cache, info.ka);
+        writeVector(cache, info.kd);
+        writeVector(cache, info.ks);
+        cache.writeFloats(values, 3);
+        cache.writeInt(info.env_map);
+        cache.writeString(info.diffuse_map);
+        cache.writeInt(info.diffuse_wrap);
+        cache.writeString(info.specular_map);
+        cache.writeInt(info.specular_wrap);
+    }
+
+    cache.writeInt(m_node_info.size());
+    foreach (const NodeInfo &info, m_node_info) {
+        cache.writeString(info.name);
+        cache.writeFloats(info.transform.constData(), 16);
+        cache.write(info.meshes);
+        cache.writeInt(info.children);
+    }
+
+    cache.writeInt(m_light_info.size());
+    foreach (const LightInfo &info, m_light_info) {
+        cache.writeInt(info.light.type);
+        cache.writeString(info.light.name);
+        writeVector(cache, info.light.pos);
+        writeVector(cache, info.light.dif);
+        writeVector(cache, info.light.spec);
+        cache.writeFloats(info.transform.constData(), 16);
+    }
+}
+
+void GLAssimpLoadModel::loadMaterial()
+{
+    m_materials.reserve(m_material_info.size());
+
+    foreach (const MaterialInfo &info, m_material_info) {
+        PhongMaterial *pm = new PhongMaterial;
+        if (!info.diffuse_map.isEmpty())
+            pm->loadDiffuseTexture(m_model_dir.filePath(info.diffuse_map),
+                                   QOpenGLTexture::WrapMode(info.diffuse_wrap));
+        if (!info.specular_map.isEmpty())
+            pm->loadSpecularTexture(m_model_dir.filePath(info.specular_map),
+                                    QOpenGLTexture::WrapMode(info.specular_wrap));
+
+        if (info.env_map)
+            pm->setEnvMap(info.reflectivity);
+
+        if (info.opacity < 1.0f) {
+            pm->setOpacity(info.opacity);
+            pm->setTransparent(true);
+        }
+
+        pm->setName(info.name);
+        pm->setMaterial(info.ka, info.kd, info.ks, info.shininess);
+
+        m_materials.append(pm);
+    }
+}
+
+GLTransformNode *GLAssimpLoadModel::loadNode(int &index)
+{
+    const NodeInfo &info = m_node_info[index++];
+
+    // meaningless node for render
+    if (info.children == 0 && info.meshes.isEmpty())
+        return NULL;
+
+    GLTransformNode *root = new GLTransformNode(info.name, info.transform);
+
+    foreach (int mesh, info.meshes) {
+        GLRenderNode *rnode = new GLRenderNode(
+                    &m_meshes[mesh],
+                    m_material ? 0 : m_materials[m_mesh_material[mesh]]
+                );
+        root->addChild(rnode);
+    }
+
+    for (int i = 0; i < info.children && index < m_node_info.size(); i++) {
+        GLTransformNode *tnode = loadNode(index);
+        if (tnode)
+            root->addChild(tnode);
+    }
+
+    return root;
+}
+
+void GLAssimpLoadModel::loadLight()
+{
+    m_lights.reserve(m_light_info.size());
+
+    foreach (const LightInfo &info, m_light_info) {
+        Light *light = new Light(info.light);
+        light->node = new GLTransformNode(light->name, info.transform);
+        m_lights.append(light);
+    }
 }
 
 void GLAssimpLoadModel::printCamera(aiCamera *camera)
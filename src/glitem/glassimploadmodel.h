@@ -2,8 +2,12 @@
 #define GLASSIMPLOADMODEL_H
 
 #include "glmodel.h"
+#include "light.h"
+#include "sharedmodel.h"
 #include <QUrl>
 #include <QDir>
+#include <QStringList>
+#include <QMatrix4x4>
 #include <assimp/material.h>
 
 class aiMaterial;
@@ -12,12 +16,16 @@ class aiLight;
 class aiNode;
 class aiScene;
 class PhongMaterial;
+class ModelCache;
 
 class GLAssimpLoadModel : public GLModel
 {
     Q_OBJECT
     Q_PROPERTY(QUrl file READ file WRITE setFile NOTIFY fileChanged)
     Q_PROPERTY(bool ignoreLight READ ignoreLight WRITE setIgnoreLight NOTIFY ignoreLightChanged)
+    Q_PROPERTY(bool cache READ cache WRITE setCache NOTIFY cacheChanged)
+    Q_PROPERTY(QString importProfile READ importProfile WRITE setImportProfile NOTIFY importProfileChanged)
+    Q_PROPERTY(QStringList importFlags READ importFlags WRITE setImportFlags NOTIFY importFlagsChanged)
 public:
     GLAssimpLoadModel(QObject *parent = 0);
     ~GLAssimpLoadModel();
@@ -28,26 +36,98 @@ public:
     bool ignoreLight() { return m_ignore_light; }
     void setIgnoreLight(bool value);
 
+    // keep the post-processed scene in the model cache
+    bool cache() { return m_cache; }
+    void setCache(bool value);
+
+    // post-process steps run on import: "default", "fastImport" which
+    // skips vertex joining, or "runtimeFast" which also merges meshes,
+    // flattens the graph and improves vertex cache locality
+    QString importProfile() { return m_import_profile; }
+    void setImportProfile(const QString &value);
+
+    // aiProcess_ names without prefix, replace the profile when set
+    QStringList importFlags() { return m_import_flags; }
+    void setImportFlags(const QStringList &value);
+
     virtual bool load();
 
 signals:
     void fileChanged();
     void ignoreLightChanged();
+    void cacheChanged();
+    void importProfileChanged();
+    void importFlagsChanged();
 
 private:
     QUrl m_file;
     QDir m_model_dir;
     bool m_ignore_light;
+    bool m_cache;
+    QString m_import_profile;
+    QStringList m_import_flags;
 
     const aiScene *m_scene;
 
+    // scene converted from assimp, or read back from the cache
+    struct MaterialInfo {
+        QString name;
+        QVector3D ka;
+        QVector3D kd;
+        QVector3D ks;
+        float shininess;
+        float opacity;
+        bool env_map;
+        float reflectivity;
+        // relative to the model file
+        QString diffuse_map;
+        QString specular_map;
+        int diffuse_wrap;
+        int specular_wrap;
+    };
+    QVector<MaterialInfo> m_material_info;
+
+    // node tree in pre-order
+    struct NodeInfo {
+        QString name;
+        QMatrix4x4 transform;
+        QVector<int> meshes;
+        int children;
+    };
+    QVector<NodeInfo> m_node_info;
+
+    struct LightInfo {
+        Light light;
+        QMatrix4x4 transform;
+    };
+    QVector<LightInfo> m_light_info;
+
+    QVector<int> m_mesh_material;
+
+    // converted scene shared with models importing the same file
+    struct SharedScene : public SharedModel {
+        QVector<MaterialInfo> material_info;
+        QVector<NodeInfo> node_info;
+        QVector<LightInfo> light_info;
+        QVector<int> mesh_material;
+    };
+
     void assign(QVector3D &qv, const aiVector3D &av);
     void assign(QVector3D &qc, const aiColor3D &ac);
 
-    void loadPrimitive();
+    uint postProcessFlags();
+    bool importScene(const QString &path, uint flags);
+    void readPrimitive();
+    void readMaterial();
+    bool readTexture(aiMaterial *material, aiTextureType type, QString &path, int &wrap);
+    void readNode(aiNode *node);
+    void readLight();
+
+    bool readSceneCache(ModelCache &cache);
+    void writeSceneCache(ModelCache &cache);
+
     void loadMaterial();
-    bool loadTexture(aiMaterial *material, aiTextureType type, PhongMaterial *pmaterial);
-    GLTransformNode *loadNode(aiNode *node);
+    GLTransformNode *loadNode(int &index);
     void loadLight();
 
     // debug prints
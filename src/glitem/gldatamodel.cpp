@@ -2,15 +2,104 @@
 #include "glnode.h"
 #include "glmaterial.h"
 #include <QDebug>
+#include <QVariant>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 
 GLDataModel::GLDataModel(QObject *parent)
-    : GLModel(parent)
+    : GLModel(parent), m_index_size(4), m_dynamic(false),
+      m_dirty_low(0), m_dirty_high(0)
 {
 
 }
 
+// every index below nvertex and no triangle using a vertex twice
+static bool validIndices(const uint *index, int count, uint nvertex)
+{
+    int i = 0;
+    uint bad = 0;
+
+#ifdef __SSE2__
+    // four triangles a step, corners gathered into one vector each,
+    // unsigned compare done signed with the sign bits flipped
+    const __m128i sign = _mm_set1_epi32(0x80000000);
+    const __m128i limit = _mm_xor_si128(_mm_set1_epi32(nvertex), sign);
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 12 <= count; i += 12) {
+        __m128 x = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(index + i)));
+        __m128 y = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(index + i + 4)));
+        __m128 z = _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(index + i + 8)));
+
+        __m128 t = _mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 2, 2));
+        __m128i a = _mm_castps_si128(_mm_shuffle_ps(x, t, _MM_SHUFFLE(2, 0, 3, 0)));
+        __m128 u = _mm_shuffle_ps(x, y, _MM_SHUFFLE(0, 0, 1, 1));
+        __m128 v = _mm_shuffle_ps(y, z, _MM_SHUFFLE(2, 2, 3, 3));
+        __m128i b = _mm_castps_si128(_mm_shuffle_ps(u, v, _MM_SHUFFLE(2, 0, 2, 0)));
+        u = _mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 1, 2, 2));
+        v = _mm_shuffle_ps(z, z, _MM_SHUFFLE(3, 3, 0, 0));
+        __m128i c = _mm_castps_si128(_mm_shuffle_ps(u, v, _MM_SHUFFLE(2, 0, 2, 0)));
+
+        acc = _mm_or_si128(acc, _mm_cmpeq_epi32(a, b));
+        acc = _mm_or_si128(acc, _mm_cmpeq_epi32(a, c));
+        acc = _mm_or_si128(acc, _mm_cmpeq_epi32(b, c));
+
+        // in range lanes are all ones, flip to flag the others
+        __m128i in = _mm_and_si128(_mm_cmplt_epi32(_mm_xor_si128(a, sign), limit),
+                     _mm_and_si128(_mm_cmplt_epi32(_mm_xor_si128(b, sign), limit),
+                                   _mm_cmplt_epi32(_mm_xor_si128(c, sign), limit)));
+        acc = _mm_or_si128(acc, _mm_andnot_si128(in, _mm_set1_epi32(-1)));
+    }
+    bad = _mm_movemask_epi8(acc);
+#endif
+
+    // no early exit so the compiler can vectorize it too
+    for (; i < count; i += 3) {
+        uint a = index[i], b = index[i + 1], c = index[i + 2];
+        bad |= (a >= nvertex) | (b >= nvertex) | (c >= nvertex) |
+               (a == b) | (a == c) | (b == c);
+    }
+
+    return !bad;
+}
+
 bool GLDataModel::load()
+{
+    if (!(m_vertex_data.isEmpty() ? loadLists() : loadData()))
+        return false;
+
+    if (!validIndices(m_geometry.indices(), m_geometry.indexCount(), m_geometry.vertexCount())) {
+        qWarning() << "data model index invalid: " << name();
+        m_geometry.clear();
+        return false;
+    }
+
+    Q_ASSERT(m_material);
+
+    m_meshes.resize(1);
+    m_meshes[0].type = m_uvs.isEmpty() && m_uv_data.isEmpty() ? Mesh::NORMAL : Mesh::TEXTURED;
+    m_meshes[0].index_offset = 0;
+    m_meshes[0].index_count = m_geometry.indexCount();
+
+    // updates address vertices by their index in the data
+    if (m_dynamic) {
+        QMutexLocker locker(&m_stream_mutex);
+        m_stream = m_geometry.vertexArray();
+        m_dirty_low = m_dirty_high = 0;
+    }
+    else
+        optimizeGeometry();
+
+    // created by the item before the load was queued
+    Material *material = m_material->loadedMaterial();
+    Q_ASSERT(material);
+    m_rnodes.append(new GLRenderNode(&m_meshes[0], material));
+
+    return GLModel::load();
+}
+
+bool GLDataModel::loadLists()
 {
     if (m_vertices.size() < 9 ||
         m_vertices.size() % 3 ||
@@ -23,61 +112,252 @@ bool GLDataModel::load()
     }
 
     int nv = m_vertices.size() / 3;
-    for (int i = 0; i < m_indices.size(); i += 3) {
-        if (m_indices[i] >= nv ||
-            m_indices[i + 1] >= nv ||
-            m_indices[i + 2] >= nv ||
-            m_indices[i] == m_indices[i + 1] ||
-            m_indices[i] == m_indices[i + 2] ||
-            m_indices[i + 1] == m_indices[i + 2]) {
-            qWarning() << "data model index invalid: " << name();
-            return false;
+
+    m_geometry.clear();
+    m_geometry.reserve(nv, m_indices.size());
+
+    Vertex *vertex = m_geometry.addVertices(nv);
+    for (int i = 0; i < nv; i++) {
+        vertex[i].position[0] = m_vertices[i * 3];
+        vertex[i].position[1] = m_vertices[i * 3 + 1];
+        vertex[i].position[2] = m_vertices[i * 3 + 2];
+
+        vertex[i].normal[0] = m_normals[i * 3];
+        vertex[i].normal[1] = m_normals[i * 3 + 1];
+        vertex[i].normal[2] = m_normals[i * 3 + 2];
+
+        if (!m_uvs.isEmpty()) {
+            vertex[i].uv[0] = m_uvs[i * 2];
+            vertex[i].uv[1] = m_uvs[i * 2 + 1];
         }
     }
 
-    QList<float> *va;
-    QList<ushort> *ia;
-    Mesh::Type type;
-    if (m_uvs.isEmpty()) {
-        va = &m_vertex;
-        ia = &m_index;
-        type = Mesh::NORMAL;
+    // negative indices wrap around and fail validation
+    uint *index = m_geometry.addIndices(m_indices.size());
+    for (int i = 0; i < m_indices.size(); i++)
+        index[i] = m_indices[i];
+
+    return true;
+}
+
+bool GLDataModel::loadData()
+{
+    int nfloat = m_vertex_data.size() / sizeof(float);
+    int nindex = m_index_size == 2 || m_index_size == 4 ? m_index_data.size() / m_index_size : 0;
+
+    if (nfloat < 9 ||
+        nfloat % 3 ||
+        m_vertex_data.size() % sizeof(float) ||
+        nindex < 3 ||
+        nindex % 3 ||
+        m_index_data.size() % m_index_size ||
+        m_normal_data.size() != m_vertex_data.size() ||
+        (!m_uv_data.isEmpty() && m_uv_data.size() * 3 != m_vertex_data.size() * 2)) {
+        qWarning() << "data model data invalid: " << name();
+        return false;
+    }
+
+    int nv = nfloat / 3;
+
+    m_geometry.clear();
+    m_geometry.reserve(nv, nindex);
+
+    // read in place from the arrays, only interleaved once
+    const float *position = (const float *)m_vertex_data.constData();
+    const float *normal = (const float *)m_normal_data.constData();
+    const float *uv = m_uv_data.isEmpty() ? 0 : (const float *)m_uv_data.constData();
+
+    Vertex *vertex = m_geometry.addVertices(nv);
+    for (int i = 0; i < nv; i++) {
+        memcpy(vertex[i].position, position + i * 3, sizeof(vertex[i].position));
+        memcpy(vertex[i].normal, normal + i * 3, sizeof(vertex[i].normal));
+        if (uv)
+            memcpy(vertex[i].uv, uv + i * 2, sizeof(vertex[i].uv));
     }
+
+    uint *index = m_geometry.addIndices(nindex);
+    if (m_index_size == 4)
+        memcpy(index, m_index_data.constData(), nindex * sizeof(uint));
     else {
-        va = &m_textured_vertex;
-        ia = &m_textured_index;
-        type = Mesh::TEXTURED;
-        m_textured_vertex_uv.reserve(m_uvs.size());
+        const ushort *index16 = (const ushort *)m_index_data.constData();
+        for (int i = 0; i < nindex; i++)
+            index[i] = index16[i];
     }
 
-    va->reserve(m_vertices.size() * 2);
-    ia->reserve(m_indices.size());
+    return true;
+}
 
-    for (int i = 0; i < m_vertices.size(); i += 3) {
-        va->append(m_vertices[i]);
-        va->append(m_vertices[i + 1]);
-        va->append(m_vertices[i + 2]);
+template <class S, class T>
+static void convertArray(const S *src, int count, T *dst)
+{
+    for (int i = 0; i < count; i++)
+        dst[i] = T(src[i]);
+}
+
+template <class T>
+static void convertArray(const T *src, int count, T *dst)
+{
+    memcpy(dst, src, count * sizeof(T));
+}
+
+template <class S, class T>
+static void convertBytes(const QByteArray &bytes, QByteArray &data)
+{
+    int count = bytes.size() / sizeof(S);
+    data.resize(count * sizeof(T));
+    convertArray((const S *)bytes.constData(), count, (T *)data.data());
+}
+
+// elements of a typed array converted to T in one pass over the bytes
+// of its buffer, false when the engine doesn't hand them out
+template <class T>
+static bool fromTypedArray(const QJSValue &value, QByteArray &data)
+{
+    QVariant buffer = value.property("buffer").toVariant();
+    if (buffer.userType() != QMetaType::QByteArray)
+        return false;
+
+    QByteArray bytes = buffer.toByteArray().mid(value.property("byteOffset").toInt(),
+                                                value.property("byteLength").toInt());
+    QString type = value.property("constructor").property("name").toString();
+    if (type == "Float32Array")
+        convertBytes<float, T>(bytes, data);
+    else if (type == "Float64Array")
+        convertBytes<double, T>(bytes, data);
+    else if (type == "Int8Array")
+        convertBytes<qint8, T>(bytes, data);
+    else if (type == "Uint8Array" || type == "Uint8ClampedArray")
+        convertBytes<quint8, T>(bytes, data);
+    else if (type == "Int16Array")
+        convertBytes<qint16, T>(bytes, data);
+    else if (type == "Uint16Array")
+        convertBytes<quint16, T>(bytes, data);
+    else if (type == "Int32Array")
+        convertBytes<qint32, T>(bytes, data);
+    else if (type == "Uint32Array")
+        convertBytes<quint32, T>(bytes, data);
+    else
+        return false;
+    return true;
+}
+
+// elements of a JS array, typed array or ArrayBuffer of T converted to
+// T, false when value is none of them
+template <class T>
+static bool fromJSArray(const QJSValue &value, QByteArray &data)
+{
+    if (!value.isObject())
+        return false;
 
-        va->append(m_normals[i]);
-        va->append(m_normals[i + 1]);
-        va->append(m_normals[i + 2]);
+    // typed arrays and ArrayBuffers are converted from their bytes, plain
+    // arrays element by element
+    if (value.property("BYTES_PER_ELEMENT").isNumber()) {
+        if (fromTypedArray<T>(value, data))
+            return true;
+    }
+    else if (value.property("byteLength").isNumber()) {
+        QVariant buffer = value.toVariant();
+        if (buffer.userType() != QMetaType::QByteArray ||
+            buffer.toByteArray().size() % sizeof(T)) {
+            qWarning("wrap ArrayBuffer data in a typed array like Float32Array");
+            return false;
+        }
+        data = buffer.toByteArray();
+        return true;
     }
 
-    for (int i = 0; i < m_indices.size(); i++)
-        ia->append(m_indices[i]);
+    QJSValue length = value.property("length");
+    if (!length.isNumber())
+        return false;
 
-    for (int i = 0; i < m_uvs.size(); i++)
-        m_textured_vertex_uv.append(m_uvs[i]);
+    int count = length.toInt();
+    data.resize(count * sizeof(T));
+    T *p = (T *)data.data();
+    for (int i = 0; i < count; i++)
+        p[i] = T(value.property(quint32(i)).toNumber());
+    return true;
+}
 
-    Q_ASSERT(m_material);
+bool GLDataModel::setArrays(const QJSValue &vertices, const QJSValue &normals,
+                            const QJSValue &indices, const QJSValue &uvs)
+{
+    QByteArray vertex_data, normal_data, index_data, uv_data;
+    if (!fromJSArray<float>(vertices, vertex_data) ||
+        !fromJSArray<float>(normals, normal_data) ||
+        !fromJSArray<uint>(indices, index_data) ||
+        (!uvs.isUndefined() && !uvs.isNull() && !fromJSArray<float>(uvs, uv_data))) {
+        qWarning() << "data model arrays are not arrays or typed arrays: " << name();
+        return false;
+    }
 
-    m_meshes.resize(1);
-    m_meshes[0].type = type;
-    m_meshes[0].index_offset = 0;
-    m_meshes[0].index_count = ia->size();
+    m_vertex_data = vertex_data;
+    m_normal_data = normal_data;
+    m_index_data = index_data;
+    m_uv_data = uv_data;
+    m_index_size = sizeof(uint);
+    return true;
+}
+
+void GLDataModel::updateVertices(int first, const QJSValue &positions, const QJSValue &normals)
+{
+    QByteArray position_data, normal_data;
+    if (!fromJSArray<float>(positions, position_data) ||
+        (!normals.isUndefined() && !normals.isNull() &&
+         !fromJSArray<float>(normals, normal_data))) {
+        qWarning() << "data model update arrays are not arrays or typed arrays: " << name();
+        return;
+    }
+    updateVertices(first, position_data, normal_data);
+}
 
-    m_rnodes.append(new GLRenderNode(&m_meshes[0], m_material->material()));
+void GLDataModel::updateVertices(int first, const QByteArray &positions, const QByteArray &normals)
+{
+    int count = positions.size() / (3 * sizeof(float));
+    if (!m_dynamic ||
+        positions.size() % (3 * sizeof(float)) ||
+        (!normals.isEmpty() && normals.size() != positions.size())) {
+        qWarning() << "data model update invalid: " << name();
+        return;
+    }
 
-    return GLModel::load();
+    {
+        QMutexLocker locker(&m_stream_mutex);
+        if (first < 0 || first + count > m_stream.size()) {
+            qWarning() << "data model update out of range: " << name();
+            return;
+        }
+
+        const float *position = (const float *)positions.constData();
+        const float *normal = normals.isEmpty() ? 0 : (const float *)normals.constData();
+        Vertex *vertex = m_stream.data() + first;
+        for (int i = 0; i < count; i++) {
+            memcpy(vertex[i].position, position + i * 3, sizeof(vertex[i].position));
+            if (normal)
+                memcpy(vertex[i].normal, normal + i * 3, sizeof(vertex[i].normal));
+        }
+
+        if (m_dirty_low < m_dirty_high) {
+            m_dirty_low = qMin(m_dirty_low, first);
+            m_dirty_high = qMax(m_dirty_high, first + count);
+        }
+        else {
+            m_dirty_low = first;
+            m_dirty_high = first + count;
+        }
+    }
+
+    emit modelChanged();
 }
 
+bool GLDataModel::takeVertices(QVector<Vertex> &vertices, int &first)
+{
+    QMutexLocker locker(&m_stream_mutex);
+    if (m_dirty_low >= m_dirty_high)
+        return false;
+
+    // copy out only the changed range, the caller may update meanwhile
+    vertices = m_stream.mid(m_dirty_low, m_dirty_high - m_dirty_low);
+    first = m_dirty_low;
+    m_dirty_low = m_dirty_high = 0;
+    return true;
+}
@@ -2,6 +2,9 @@
 #define GLDATAMODEL_H
 
 #include "glmodel.h"
+#include <QByteArray>
+#include <QMutex>
+#include <QJSValue>
 
 class GLDataModel : public GLModel
 {
@@ -10,6 +13,12 @@ class GLDataModel : public GLModel
     Q_PROPERTY(QList<qreal> normals READ normals WRITE setNormals)
     Q_PROPERTY(QList<qreal> uvs READ uvs WRITE setUvs)
     Q_PROPERTY(QList<int> indices READ indices WRITE setIndices)
+    Q_PROPERTY(QByteArray vertexData READ vertexData WRITE setVertexData)
+    Q_PROPERTY(QByteArray normalData READ normalData WRITE setNormalData)
+    Q_PROPERTY(QByteArray uvData READ uvData WRITE setUvData)
+    Q_PROPERTY(QByteArray indexData READ indexData WRITE setIndexData)
+    Q_PROPERTY(int indexSize READ indexSize WRITE setIndexSize)
+    Q_PROPERTY(bool dynamic READ dynamic WRITE setDynamic)
 public:
     GLDataModel(QObject *parent = 0);
 
@@ -25,13 +34,68 @@ public:
     QList<int> indices() { return m_indices; }
     void setIndices(const QList<int> &value) { m_indices = value; }
 
+    // binary arrays used instead of the lists when vertexData is set,
+    // 32-bit floats and indexSize byte unsigned indices, native endian
+    QByteArray vertexData() { return m_vertex_data; }
+    void setVertexData(const QByteArray &value) { m_vertex_data = value; }
+
+    QByteArray normalData() { return m_normal_data; }
+    void setNormalData(const QByteArray &value) { m_normal_data = value; }
+
+    QByteArray uvData() { return m_uv_data; }
+    void setUvData(const QByteArray &value) { m_uv_data = value; }
+
+    QByteArray indexData() { return m_index_data; }
+    void setIndexData(const QByteArray &value) { m_index_data = value; }
+
+    // 2 or 4
+    int indexSize() { return m_index_size; }
+    void setIndexSize(int value) { m_index_size = value; }
+
+    // fill the binary arrays from JS arrays or typed arrays, QML can't
+    // write a JS ArrayBuffer to the QByteArray properties before Qt 5.8,
+    // call before the model is loaded, like before GLItem.addModel()
+    Q_INVOKABLE bool setArrays(const QJSValue &vertices, const QJSValue &normals,
+                               const QJSValue &indices, const QJSValue &uvs = QJSValue());
+
+    // vertices can be changed after loading with updateVertices(),
+    // they are not reordered by optimize
+    bool dynamic() { return m_dynamic; }
+    void setDynamic(bool value) { m_dynamic = value; }
+
+    // replace positions and normals, 32-bit floats like vertexData, of
+    // the vertices from first, any thread, applied at the next frame
+    void updateVertices(int first, const QByteArray &positions,
+                        const QByteArray &normals = QByteArray());
+    // same from JS arrays or typed arrays
+    Q_INVOKABLE void updateVertices(int first, const QJSValue &positions,
+                                    const QJSValue &normals = QJSValue());
+
     virtual bool load();
+    virtual bool takeVertices(QVector<Vertex> &vertices, int &first);
 
 private:
     QList<qreal> m_vertices;
     QList<qreal> m_normals;
     QList<qreal> m_uvs;
     QList<int> m_indices;
+
+    QByteArray m_vertex_data;
+    QByteArray m_normal_data;
+    QByteArray m_uv_data;
+    QByteArray m_index_data;
+    int m_index_size;
+    bool m_dynamic;
+
+    // vertices of a dynamic model and the range changed since the
+    // render last took them
+    QMutex m_stream_mutex;
+    QVector<Vertex> m_stream;
+    int m_dirty_low;
+    int m_dirty_high;
+
+    bool loadLists();
+    bool loadData();
 };
 
 #endif // GLDATAMODEL_H
@@ -2,7 +2,7 @@
 
 
 GLEnvironment::GLEnvironment(QObject *parent)
-    : QObject(parent)
+    : QObject(parent), m_srgb(false)
 {
 
 }
@@ -55,3 +55,19 @@ void GLEnvironment::setBack(const QUrl &value)
     }
 }
 
+
+void GLEnvironment::setSource(const QUrl &value)
+{
+    if (m_source != value) {
+        m_source = value;
+        emit sourceChanged();
+    }
+}
+
+void GLEnvironment::setSrgb(bool value)
+{
+    if (m_srgb != value) {
+        m_srgb = value;
+        emit srgbChanged();
+    }
+}
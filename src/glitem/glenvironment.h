@@ -4,16 +4,30 @@
 #include <QObject>
 #include <QImage>
 #include <QUrl>
+#include "ktximage.h"
 
 struct EnvParam {
+    EnvParam() : width(0), height(0), srgb(false) {
+        for (int i = 0; i < 6; i++)
+            ktx[i] = 0;
+    }
+    ~EnvParam() {
+        for (int i = 0; i < 6; i++)
+            delete ktx[i];
+    }
+
     QImage top;
     QImage bottom;
     QImage left;
     QImage right;
     QImage front;
     QImage back;
+    // faces stored as KTX, in GL cube map face order +x -x +y -y +z -z
+    KtxImage *ktx[6];
     int width;
     int height;
+    // faces are sRGB encoded
+    bool srgb;
 };
 
 class GLEnvironment : public QObject
@@ -25,6 +39,8 @@ class GLEnvironment : public QObject
     Q_PROPERTY(QUrl right READ right WRITE setRight NOTIFY rightChanged)
     Q_PROPERTY(QUrl front READ front WRITE setFront NOTIFY frontChanged)
     Q_PROPERTY(QUrl back READ back WRITE setBack NOTIFY backChanged)
+    Q_PROPERTY(QUrl source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(bool srgb READ srgb WRITE setSrgb NOTIFY srgbChanged)
 public:
     GLEnvironment(QObject *parent = 0);
 
@@ -35,6 +51,15 @@ public:
     QUrl front() const { return m_front; }
     QUrl back() const { return m_back; }
 
+    // single image with all faces, a horizontal or vertical cross or
+    // an equirectangular panorama, used instead of the face urls
+    QUrl source() const { return m_source; }
+    void setSource(const QUrl &value);
+
+    // sample the faces as sRGB encoded
+    bool srgb() const { return m_srgb; }
+    void setSrgb(bool value);
+
     void setTop(const QUrl &value);
     void setBottom(const QUrl &value);
     void setLeft(const QUrl &value);
@@ -49,6 +74,8 @@ signals:
     void rightChanged();
     void frontChanged();
     void backChanged();
+    void sourceChanged();
+    void srgbChanged();
 
 private:
     QUrl m_top;
@@ -57,6 +84,8 @@ private:
     QUrl m_right;
     QUrl m_front;
     QUrl m_back;
+    QUrl m_source;
+    bool m_srgb;
 };
 
 #endif // GLENVIRONMENT_H
@@ -1,5 +1,7 @@
 #include <QQuickWindow>
 #include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
 #include "glitem.h"
 #include "glmodel.h"
 #include "glnode.h"
@@ -8,14 +10,23 @@
 #include "glmaterial.h"
 #include "gllight.h"
 #include "material.h"
+#include "geometry.h"
+#include "compactvertex.h"
+#include "texture.h"
+#include "cubemap.h"
 
 
 GLItem::GLItem(QQuickItem *parent)
-    : QQuickItem(parent), m_render(0), m_root(0),
-      m_status(Null), m_asynchronous(true),
-      m_environment(0), m_envparam(0), m_has_texture_uv(false)
+    : QQuickItem(parent), m_render(0), m_root(0), m_model_node(0),
+      m_status(Null), m_asynchronous(true), m_progressive(false),
+      m_compact_vertex(false), m_lod_bias(0),
+      m_environment(0), m_envparam(0),
+      m_draw_calls(0), m_texture_binds(0), m_uniform_uploads(0),
+      m_num_vertex(0), m_num_index(0),
+      m_loading(0), m_env_loaded(false)
 {
     connect(this, &GLItem::opacityChanged, this, &GLItem::updateWindow);
+    connect(this, &GLItem::lodBiasChanged, this, &GLItem::updateWindow);
 }
 
 GLItem::~GLItem()
@@ -34,19 +45,30 @@ GLItem::~GLItem()
 
 void GLItem::sync()
 {
-    if (m_status != Ready)
+    if (!m_progressive && m_status != Ready)
+        return;
+
+    reveal();
+
+    // nothing loaded yet
+    if (!m_root)
         return;
 
     if (!m_render) {
+        int max_model_vertex = 0;
+        foreach (GLModel *md, m_uploads) {
+            max_model_vertex = qMax(max_model_vertex, md->geometry().vertexCount());
+        }
+
         RenderParam param = {
             .root = m_root,
-            .vertex = &m_vertex,
-            .index = &m_index,
             .materials = &m_materials,
             .lights = &m_lights,
             .env = m_envparam,
-            .has_texture_uv = m_has_texture_uv,
-            .num_vertex = m_num_vertex
+            .num_vertex = m_num_vertex,
+            .num_index = m_num_index,
+            .max_model_vertex = max_model_vertex,
+            .compact_vertex = m_compact_vertex
         };
         m_render = new GLRender(&param);
 
@@ -58,12 +80,26 @@ void GLItem::sync()
             m_envparam = 0;
         }
 
-        m_vertex.clear();
-        m_index.clear();
-
         connect(window(), &QQuickWindow::beforeRendering, m_render, &GLRender::render, Qt::DirectConnection);
     }
 
+    const RenderState::Statistics &statistics = m_render->state()->statistics;
+    if (m_draw_calls != statistics.draw_calls ||
+        m_texture_binds != statistics.texture_binds ||
+        m_uniform_uploads != statistics.uniform_uploads) {
+        m_draw_calls = statistics.draw_calls;
+        m_texture_binds = statistics.texture_binds;
+        m_uniform_uploads = statistics.uniform_uploads;
+        QMetaObject::invokeMethod(this, "statisticsChanged", Qt::QueuedConnection);
+    }
+
+    removeModels();
+    uploadModels();
+
+    // keep rendering until placeholder textures are replaced
+    if (m_render->hasPendingTextures())
+        window()->update();
+
     QRect viewport(x(), y(), width(), height());
     m_render->setViewport(viewport);
 
@@ -79,18 +115,294 @@ void GLItem::sync()
         return;
     }
 
-    QMatrix4x4 modelview;
-    calcModelviewMatrix(m_root, modelview);
+    // visibility first, nodes shown again get their matrices below
+    QVector<Vertex> vertices;
+    int first;
+    foreach (GLModel *model, m_glmodels) {
+        if (model->status() == GLModel::Ready) {
+            if (model->sync())
+                m_render->invalidateDrawList();
+            // updates queued since the last frame land in one upload
+            if (model->takeVertices(vertices, first))
+                m_render->updateVertices(&model->geometry(), first,
+                                         vertices.constData(), vertices.size());
+        }
+    }
+
+    // only subtrees below moved nodes are computed again
+    if (m_scene.isDirty())
+        m_scene.build(m_root);
+    m_scene.update();
+    foreach (GLAnimateNode *node, m_glnodes) {
+        node->setClean();
+    }
 
     m_render->state()->setOpacity(opacity());
+    m_render->state()->setLodBias(m_lod_bias);
 
     foreach (GLLight *light, m_gllights) {
         light->sync();
     }
     m_render->updateLightFinalPos();
+}
 
-    foreach (GLModel *model, m_glmodels) {
-        model->sync();
+void GLItem::reveal()
+{
+    QList<GLModel *> models;
+    bool finished;
+    {
+        QMutexLocker locker(&m_pending_mutex);
+        // the environment map is made with the render
+        if (!m_env_loaded)
+            return;
+        models.swap(m_pending);
+        finished = !m_loading;
+    }
+
+    if (models.isEmpty())
+        return;
+
+    bool first = !m_root;
+    int num_lights = m_lights.size();
+    QList<Material *> materials;
+    foreach (GLModel *md, models) {
+        replaceMaterials(md);
+        materials.append(md->materials());
+        mergeModel(md);
+    }
+
+    if (first) {
+        bindLights();
+        foreach (GLMaterial *glmaterial, m_glmaterials) {
+            m_materials.append(glmaterial->material());
+        }
+    }
+    else {
+        bool lights = rebindLights(m_lights.mid(num_lights));
+        if (m_render) {
+            // shaders are built for the lights of the scene
+            if (lights) {
+                if (!num_lights)
+                    m_render->state()->setLightAmb(QVector3D());
+                m_render->updateLights();
+            }
+            m_render->addMaterials(materials);
+        }
+    }
+
+    bindAnimateNodes(finished);
+
+    foreach (GLModel *md, models) {
+        md->setStatus(GLModel::Ready);
+    }
+}
+
+void GLItem::modelLoaded(GLModel *md, bool ok)
+{
+    if (!ok)
+        md->setStatus(GLModel::Error);
+
+    QMutexLocker locker(&m_pending_mutex);
+    if (ok)
+        m_pending.append(md);
+    m_loading--;
+    locker.unlock();
+
+    QMetaObject::invokeMethod(this, "updateWindow", Qt::QueuedConnection);
+}
+
+void GLItem::mergeModel(GLModel *md)
+{
+    if (!m_root) {
+        m_root = new GLTransformNode("view");
+        m_model_node = new GLTransformNode("model");
+        m_root->addChild(m_model_node);
+    }
+
+    m_model_node->addChild(md->tnodes());
+    m_model_node->addChild(md->rnodes());
+
+    foreach (Light *light, md->lights()) {
+        m_model_node->addChild(light->node);
+    }
+    m_lights.append(md->lights());
+
+    m_materials.append(md->materials());
+    m_model_materials.insert(md, md->materials());
+
+    // the render places the geometry in its buffers, the sizes of
+    // the first models merged are the initial buffer sizes
+    Geometry &geometry = md->geometry();
+
+    QMatrix4x4 position_matrix;
+    if (m_compact_vertex)
+        position_matrix = CompactVertex::dequantizeMatrix(geometry);
+
+    for (int j = 0; j < md->meshes().size(); j++)
+        md->meshes()[j].position_matrix = position_matrix;
+
+    m_num_vertex += geometry.vertexCount();
+    m_num_index += geometry.indexCount();
+    m_uploads.append(md);
+}
+
+void GLItem::unmergeModel(GLModel *md)
+{
+    foreach (GLTransformNode *tnode, md->tnodes()) {
+        m_model_node->removeChild(tnode);
+    }
+    foreach (GLRenderNode *rnode, md->rnodes()) {
+        m_model_node->removeChild(rnode);
+    }
+
+    // lights stay, shaders are built for their number
+
+    QList<Material *> materials = m_model_materials.take(md);
+    if (m_render) {
+        m_render->removeMaterials(materials);
+        m_render->removeGeometry(&md->geometry());
+    }
+    foreach (Material *material, materials) {
+        m_materials.removeOne(material);
+        delete material;
+    }
+
+    m_uploads.removeOne(md);
+    md->unload();
+}
+
+void GLItem::replaceMaterials(GLModel *md)
+{
+    foreach (GLMaterial *glmaterial, m_glmaterials) {
+        Material *material = glmaterial->material();
+        if (material->name().isEmpty())
+            continue;
+
+        foreach (Material *m, md->materials()) {
+            if (material->name() == m->name()) {
+                foreach (GLTransformNode *tnode, md->tnodes()) {
+                    replaceMaterial(tnode, m, material);
+                }
+                foreach (GLRenderNode *rnode, md->rnodes()) {
+                    if (rnode->material() == m)
+                        rnode->setMaterial(material);
+                }
+                md->materials().removeOne(m);
+                delete m;
+                break;
+            }
+        }
+    }
+}
+
+void GLItem::bindLights()
+{
+    foreach (GLLight *gllight, m_gllights) {
+        bool found = false;
+        foreach (Light *light, m_lights) {
+            if (gllight->name() == light->name) {
+                // use view node when controled by GLLight
+                m_model_node->removeChild(light->node);
+                if (gllight->view())
+                    light->node = m_root;
+                else
+                    light->node = m_model_node;
+
+                gllight->setLight(light);
+                found = true;
+                break;
+            }
+        }
+
+        if (!found) {
+            Light *light = new Light;
+            light->name = gllight->name();
+            if (gllight->view())
+                light->node = m_root;
+            else
+                light->node = m_model_node;
+
+            gllight->setLight(light);
+            m_lights.append(light);
+            m_placeholder_lights.insert(gllight, light);
+        }
+    }
+}
+
+bool GLItem::rebindLights(const QList<Light *> &lights)
+{
+    if (lights.isEmpty())
+        return false;
+
+    // lights of models revealed later replace the placeholders
+    // named after them, GLLights bound to a model light keep it
+    QHash<GLLight *, Light *>::iterator it = m_placeholder_lights.begin();
+    while (it != m_placeholder_lights.end()) {
+        GLLight *gllight = it.key();
+        Light *placeholder = it.value();
+        bool found = false;
+        foreach (Light *light, lights) {
+            if (gllight->name() == light->name) {
+                m_model_node->removeChild(light->node);
+                light->node = placeholder->node;
+
+                gllight->setLight(light);
+                m_lights.removeOne(placeholder);
+                delete placeholder;
+                found = true;
+                break;
+            }
+        }
+
+        if (found)
+            it = m_placeholder_lights.erase(it);
+        else
+            ++it;
+    }
+
+    return true;
+}
+
+void GLItem::bindAnimateNodes(bool warn)
+{
+    // nodes are found by name in the scene store
+    if (m_scene.isDirty())
+        m_scene.build(m_root);
+
+    // binding again the nodes of models merged before is harmless
+    foreach (GLAnimateNode *anim, m_glnodes) {
+        QList<GLTransformNode *> nodes = m_scene.find(anim->name());
+        if (nodes.isEmpty() && warn)
+            qWarning() << "no node find in model named: " << anim->name();
+        foreach (GLTransformNode *node, nodes) {
+            node->setAnimateNode(anim);
+        }
+    }
+}
+
+void GLItem::uploadModels()
+{
+    // free data stored in models once it is in GPU buffers
+    foreach (GLModel *md, m_uploads) {
+        m_render->addGeometry(&md->geometry(), md->meshes(), md->dynamic(), md->shared());
+        md->release();
+    }
+    m_uploads.clear();
+}
+
+void GLItem::removeModels()
+{
+    for (int i = 0; i < m_removed.size(); ) {
+        GLModel *md = m_removed[i];
+        // still loading ones are merged first, then taken out
+        if (md->status() == GLModel::Loading) {
+            i++;
+            continue;
+        }
+
+        if (md->status() == GLModel::Ready)
+            unmergeModel(md);
+        m_removed.removeAt(i);
     }
 }
 
@@ -116,6 +428,30 @@ void GLItem::setAsynchronous(bool value)
     }
 }
 
+void GLItem::setProgressive(bool value)
+{
+    if (m_progressive != value) {
+        m_progressive = value;
+        emit progressiveChanged();
+    }
+}
+
+void GLItem::setCompactVertex(bool value)
+{
+    if (m_compact_vertex != value) {
+        m_compact_vertex = value;
+        emit compactVertexChanged();
+    }
+}
+
+void GLItem::setLodBias(qreal value)
+{
+    if (m_lod_bias != value) {
+        m_lod_bias = value;
+        emit lodBiasChanged();
+    }
+}
+
 void GLItem::setEnvironment(GLEnvironment *value)
 {
     if (m_environment != value) {
@@ -124,201 +460,320 @@ void GLItem::setEnvironment(GLEnvironment *value)
     }
 }
 
-bool GLItem::loadEnvironmentImage(const QUrl &url, QImage &image)
+class ModelLoadTask : public QRunnable
 {
-    if (!url.isEmpty()) {
-        QString path;
-        if (url.scheme() == "file")
-            path = url.toLocalFile();
-        else if (url.scheme() == "qrc")
-            path = ':' + url.path();
-        else {
-            qWarning() << "invalide environment texture path: " << url;
-            return false;
-        }
-
-        if (image.load(path)) {
-            Q_ASSERT(image.width() == image.height());
-            Q_ASSERT(!m_envparam->width || m_envparam->width == image.width());
-            Q_ASSERT(!m_envparam->height || m_envparam->height == image.height());
+public:
+    ModelLoadTask(GLModel *model, bool *result, GLItem *item)
+        : m_model(model), m_result(result), m_item(item)
+    {}
 
-            image = image.convertToFormat(QImage::Format_RGBA8888);
-            m_envparam->width = image.width();
-            m_envparam->height = image.height();
-            return true;
-        }
+    void run() {
+        bool ok = m_model->load();
+        if (m_result)
+            *m_result = ok;
+        if (m_item)
+            m_item->modelLoaded(m_model, ok);
     }
-    return false;
-}
+
+private:
+    GLModel *m_model;
+    // set when the caller waits for the task
+    bool *m_result;
+    // set when the model is revealed as soon as it is loaded
+    GLItem *m_item;
+};
 
 void GLItem::load()
 {
     m_status = Loading;
     emit statusChanged();
 
-    GLTransformNode *view = NULL, *model = NULL;
-    for (int i = 0; i < m_glmodels.size(); i++) {
-        GLModel *md = m_glmodels[i];
+    // models added from now on are loaded by addModel()
+    QList<GLModel *> models = m_glmodels;
 
-        if (md->load()) {
-            if (!m_root) {
-                view = new GLTransformNode("view");
-                model = new GLTransformNode("model");
-                view->addChild(model);
-                m_root = view;
-            }
+    // materials may be shared by several models, create them before
+    // the models are loaded concurrently, loaders only read them
+    foreach (GLModel *md, models) {
+        if (md->material())
+            md->material()->material();
+        md->setStatus(GLModel::Loading);
+    }
 
-            model->addChild(md->tnodes());
-            model->addChild(md->rnodes());
+    m_pending_mutex.lock();
+    m_loading += models.size();
+    m_pending_mutex.unlock();
+
+    // load every model in its own task
+    QVector<bool> loaded(models.size());
+    QThreadPool pool;
+    for (int i = 0; i < models.size(); i++)
+        pool.start(new ModelLoadTask(models[i], &loaded[i], m_progressive ? this : 0));
+
+    if (m_progressive) {
+        // sync() merges the models as they finish and shows them with
+        // placeholder textures once the environment is there
+        loadEnvironment();
+        m_pending_mutex.lock();
+        m_env_loaded = true;
+        m_pending_mutex.unlock();
+
+        if (window()) {
+            connect(window(), &QQuickWindow::beforeSynchronizing, this, &GLItem::sync, Qt::DirectConnection);
+            connect(window(), &QQuickWindow::sceneGraphInvalidated, this, &GLItem::cleanup, Qt::DirectConnection);
+        }
+        // models may have finished before sync() was connected
+        QMetaObject::invokeMethod(this, "updateWindow", Qt::QueuedConnection);
 
-            foreach (Light *light, md->lights()) {
-                model->addChild(light->node);
-            }
-            m_lights.append(md->lights());
+        pool.waitForDone();
+        m_status = loaded.contains(true) ? Ready : Error;
+        emit statusChanged();
+        return;
+    }
+
+    pool.waitForDone();
+    // textures started decoding while the models were parsed
+    Texture::pool()->waitForDone();
 
-            m_materials.append(md->materials());
+    // results are merged in declaration order so the buffer layout
+    // stays stable
+    for (int i = 0; i < models.size(); i++) {
+        GLModel *md = models[i];
+
+        if (loaded[i]) {
+            replaceMaterials(md);
+            mergeModel(md);
         }
+        else
+            md->setStatus(GLModel::Error);
     }
 
+    m_pending_mutex.lock();
+    m_loading -= models.size();
+    m_env_loaded = true;
+    m_pending_mutex.unlock();
+
     if (!m_root) {
         m_status = Error;
         emit statusChanged();
         return;
     }
 
-    foreach (GLLight *gllight, m_gllights) {
-        bool found = false;
-        foreach (Light *light, m_lights) {
-            if (gllight->name() == light->name) {
-                // use view node when controled by GLLight
-                model->removeChild(light->node);
-                if (gllight->view())
-                    light->node = view;
-                else
-                    light->node = model;
+    bindLights();
 
-                gllight->setLight(light);
-                found = true;
-                break;
-            }
-        }
+    foreach (GLMaterial *glmaterial, m_glmaterials) {
+        m_materials.append(glmaterial->material());
+    }
 
-        if (!found) {
-            Light *light = new Light;
-            light->name = gllight->name();
-            if (gllight->view())
-                light->node = view;
-            else
-                light->node = model;
+    // bind animated node to scene graph
+    bindAnimateNodes(true);
 
-            gllight->setLight(light);
-            m_lights.append(light);
-        }
+    loadEnvironment();
+
+    if (window()) {
+        connect(window(), &QQuickWindow::beforeSynchronizing, this, &GLItem::sync, Qt::DirectConnection);
+        connect(window(), &QQuickWindow::sceneGraphInvalidated, this, &GLItem::cleanup, Qt::DirectConnection);
     }
 
-    for (int i = 0; i < m_glmaterials.size(); i++) {
-        Material *material = m_glmaterials[i]->material();
-        if (!material->name().isEmpty()) {
-            Material *fm = 0;
-            foreach (Material *m, m_materials) {
-                if (material->name() == m->name()) {
-                    fm = m;
-                    break;
-                }
-            }
-            if (fm) {
-                replaceMaterial(m_root, fm, material);
-                m_materials.removeOne(fm);
-                delete fm;
-            }
-        }
-        m_materials.append(material);
+    for (int i = 0; i < models.size(); i++) {
+        if (loaded[i])
+            models[i]->setStatus(GLModel::Ready);
     }
 
-    QList<float> vertex;
-    QList<ushort> index;
-    // build textured vertex array
-    for (int i = 0; i < m_glmodels.size(); i++) {
-        GLModel *md = m_glmodels[i];
+    m_status = Ready;
+    emit statusChanged();
+}
 
-        int ibase = vertex.size() / 6;
-        for (int j = 0; j < md->texturedIndex().size(); j++)
-            md->texturedIndex()[j] += ibase;
+void GLItem::addModel(GLModel *model)
+{
+    if (m_glmodels.contains(model))
+        return;
+
+    m_glmodels.append(model);
+    connect(model, &GLModel::modelChanged, this, &GLItem::updateWindow);
 
-        int ioff = index.size() * sizeof(ushort);
-        for (int j = 0; j < md->meshes().size(); j++)
-            if (md->meshes()[j].type == Mesh::TEXTURED)
-                md->meshes()[j].index_offset += ioff;
+    // loaded with the others by componentComplete()
+    if (m_status == Null)
+        return;
 
-        vertex.append(md->texturedVertex());
-        index.append(md->texturedIndex());
+    // removed but not taken out by sync() yet, it is still merged or
+    // will be when its load finishes, so just keep it
+    if (model->status() != GLModel::Error && m_removed.contains(model)) {
+        m_removed.removeOne(model);
+        return;
     }
+    m_removed.removeOne(model);
+
+    // loaded in the background and merged by sync(), the material is
+    // created here so the loader only reads it
+    if (model->material())
+        model->material()->material();
+    model->setStatus(GLModel::Loading);
+
+    m_pending_mutex.lock();
+    m_loading++;
+    m_pending_mutex.unlock();
+
+    QThreadPool::globalInstance()->start(new ModelLoadTask(model, 0, this));
+}
+
+void GLItem::removeModel(GLModel *model)
+{
+    if (!m_glmodels.removeOne(model))
+        return;
+
+    disconnect(model, &GLModel::modelChanged, this, &GLItem::updateWindow);
 
-    // build normal vertex array
-    for (int i = 0; i < m_glmodels.size(); i++) {
-        GLModel *md = m_glmodels[i];
+    // the scene is changed by sync() on the render thread
+    if (m_status != Null) {
+        m_removed.append(model);
+        updateWindow();
+    }
+}
 
-        int ibase = vertex.size() / 6;
-        for (int j = 0; j < md->index().size(); j++)
-            md->index()[j] += ibase;
+static bool environmentPath(const QUrl &url, QString &path)
+{
+    if (url.scheme() == "file")
+        path = url.toLocalFile();
+    else if (url.scheme() == "qrc")
+        path = ':' + url.path();
+    else {
+        qWarning() << "invalide environment texture path: " << url;
+        return false;
+    }
+    return true;
+}
 
-        int ioff = index.size() * sizeof(ushort);
-        for (int j = 0; j < md->meshes().size(); j++)
-            if (md->meshes()[j].type == Mesh::NORMAL)
-                md->meshes()[j].index_offset += ioff;
+static bool loadEnvironmentImage(const QUrl &url, QImage &image, KtxImage *&ktx)
+{
+    QString path;
+    if (url.isEmpty() || !environmentPath(url, path))
+        return false;
+
+    if (KtxImage::isKtx(path)) {
+        // decoded or uploaded compressed by the render
+        KtxImage *face = new KtxImage;
+        if (!face->load(path)) {
+            delete face;
+            return false;
+        }
+        ktx = face;
+        return true;
+    }
 
-        vertex.append(md->vertex());
-        index.append(md->index());
+    if (image.load(path)) {
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+        return true;
     }
+    return false;
+}
 
-    m_num_vertex = vertex.size() / 6;
-    Q_ASSERT(m_num_vertex < USHRT_MAX);
+class EnvImageTask : public QRunnable
+{
+public:
+    EnvImageTask(const QUrl &url, QImage *image, KtxImage **ktx, bool *result)
+        : m_url(url), m_image(image), m_ktx(ktx), m_result(result)
+    {}
 
-    // build texture uv array
-    for (int i = 0; i < m_glmodels.size(); i++) {
-        GLModel *md = m_glmodels[i];
-        if (!md->texturedVertexUV().isEmpty())
-            m_has_texture_uv = true;
-        vertex.append(md->texturedVertexUV());
-        // free data stored in model
-        md->release();
+    void run() {
+        *m_result = loadEnvironmentImage(m_url, *m_image, *m_ktx);
     }
 
-    m_vertex = vertex.toVector();
-    m_index = index.toVector();
+private:
+    QUrl m_url;
+    QImage *m_image;
+    KtxImage **m_ktx;
+    bool *m_result;
+};
 
-    // bind animated node to scene graph
-    foreach (GLAnimateNode *node, m_glnodes) {
-        if (!bindAnimateNode(m_root, node))
-            qWarning() << "no node find in model named: " << node->name();
+class EnvFaceTask : public QRunnable
+{
+public:
+    EnvFaceTask(const QImage &source, CubeMap::Layout layout, int face, QImage *image)
+        : m_source(source), m_layout(layout), m_face(face), m_image(image)
+    {}
+
+    void run() {
+        *m_image = CubeMap::face(m_source, m_layout, m_face);
     }
 
-    // load environment texture
-    if (m_environment) {
-        bool hasEnv = false;
-        m_envparam = new EnvParam;
-        m_envparam->width = m_envparam->height = 0;
+private:
+    QImage m_source;
+    CubeMap::Layout m_layout;
+    int m_face;
+    QImage *m_image;
+};
 
-        hasEnv |= loadEnvironmentImage(m_environment->top(), m_envparam->top);
-        hasEnv |= loadEnvironmentImage(m_environment->bottom(), m_envparam->bottom);
-        hasEnv |= loadEnvironmentImage(m_environment->left(), m_envparam->left);
-        hasEnv |= loadEnvironmentImage(m_environment->right(), m_envparam->right);
-        hasEnv |= loadEnvironmentImage(m_environment->front(), m_envparam->front);
-        hasEnv |= loadEnvironmentImage(m_environment->back(), m_envparam->back);
+void GLItem::loadEnvironment()
+{
+    if (!m_environment)
+        return;
 
-        if (!hasEnv) {
-            delete m_envparam;
-            m_envparam = 0;
+    m_envparam = new EnvParam;
+    m_envparam->srgb = m_environment->srgb();
+    QImage *faces[6] = {
+        &m_envparam->right, &m_envparam->left, &m_envparam->top,
+        &m_envparam->bottom, &m_envparam->back, &m_envparam->front
+    };
+
+    // faces are decoded or cut out of the source in parallel
+    bool hasEnv = false;
+    QThreadPool pool;
+    if (!m_environment->source().isEmpty()) {
+        QString path;
+        QImage source;
+        if (environmentPath(m_environment->source(), path) && source.load(path)) {
+            CubeMap::Layout layout = CubeMap::layout(source.size());
+            if (layout == CubeMap::Unknown)
+                qWarning() << "environment source is no cross nor equirectangular image: "
+                           << m_environment->source();
+            else {
+                if (layout == CubeMap::Equirectangular)
+                    source = source.convertToFormat(QImage::Format_RGBA8888);
+                for (int i = 0; i < 6; i++)
+                    pool.start(new EnvFaceTask(source, layout, i, faces[i]));
+                pool.waitForDone();
+                hasEnv = true;
+            }
         }
     }
+    else {
+        QUrl urls[6] = {
+            m_environment->right(), m_environment->left(), m_environment->top(),
+            m_environment->bottom(), m_environment->back(), m_environment->front()
+        };
+        bool loaded[6];
+        for (int i = 0; i < 6; i++)
+            pool.start(new EnvImageTask(urls[i], faces[i], &m_envparam->ktx[i], &loaded[i]));
+        pool.waitForDone();
 
-    if (window()) {
-        connect(window(), &QQuickWindow::beforeSynchronizing, this, &GLItem::sync, Qt::DirectConnection);
-        connect(window(), &QQuickWindow::sceneGraphInvalidated, this, &GLItem::cleanup, Qt::DirectConnection);
+        for (int i = 0; i < 6; i++)
+            hasEnv |= loaded[i];
     }
 
-    m_status = Ready;
-    emit statusChanged();
+    // missing faces are uploaded black, the others must be squares of
+    // one size
+    int size = 0;
+    for (int i = 0; hasEnv && i < 6; i++) {
+        KtxImage *ktx = m_envparam->ktx[i];
+        QSize face = ktx ? QSize(ktx->width(), ktx->height()) : faces[i]->size();
+        if (face.isEmpty())
+            continue;
+
+        if (face.width() != face.height() || (size && face.width() != size)) {
+            qWarning() << "environment faces must be squares of the same size";
+            hasEnv = false;
+        }
+        size = face.width();
+    }
+
+    if (!hasEnv) {
+        delete m_envparam;
+        m_envparam = 0;
+        return;
+    }
+
+    m_envparam->width = size;
+    m_envparam->height = size;
 }
 
 void GLItem::replaceMaterial(GLTransformNode *node, Material *om, Material *nm)
@@ -418,33 +873,6 @@ void GLItem::glnode_clear(QQmlListProperty<GLAnimateNode> *list)
         qWarning()<<"Warning: could not find GLItem to clear of node";
 }
 
-bool GLItem::bindAnimateNode(GLTransformNode *node, GLAnimateNode *anim)
-{
-    bool ret = false;
-    if (node->name() == anim->name()) {
-        node->setAnimateNode(anim);
-        ret = true;
-    }
-
-    foreach (GLTransformNode *tnode, node->transformChildren()) {
-        if (bindAnimateNode(tnode, anim))
-            ret = true;
-    }
-
-    return ret;
-}
-
-void GLItem::calcModelviewMatrix(GLTransformNode *node, const QMatrix4x4 &modelview)
-{
-    node->modelviewMatrix() = modelview * node->transformMatrix();
-    if (node->animateNode())
-        node->animateNode()->applyTo(&node->modelviewMatrix());
-
-    foreach (GLTransformNode *tnode, node->transformChildren()) {
-        calcModelviewMatrix(tnode, node->modelviewMatrix());
-    }
-}
-
 QQmlListProperty<GLLight> GLItem::gllight()
 {
     return QQmlListProperty<GLLight>(this, 0, gllight_append, gllight_count, gllight_at, gllight_clear);
@@ -520,16 +948,8 @@ int GLItem::glmodel_count(QQmlListProperty<GLModel> *list)
 void GLItem::glmodel_append(QQmlListProperty<GLModel> *list, GLModel *item)
 {
     GLItem *object = qobject_cast<GLItem *>(list->object);
-    QList<GLModel *> *pmodels;
-    if (object) {
-        pmodels = &object->m_glmodels;
-
-        if (!pmodels->contains(item)) {
-            pmodels->append(item);
-            connect(item, &GLModel::modelChanged,
-                    object, &GLItem::updateWindow);
-        }
-    }
+    if (object)
+        object->addModel(item);
     else
         qWarning()<<"Warning: could not find GLItem to add model to.";
 }
@@ -549,8 +969,11 @@ GLModel *GLItem::glmodel_at(QQmlListProperty<GLModel> *list, int idx)
 void GLItem::glmodel_clear(QQmlListProperty<GLModel> *list)
 {
     GLItem *object = qobject_cast<GLItem *>(list->object);
-    if (object)
-        object->m_glmodels.clear();
+    if (object) {
+        foreach (GLModel *model, object->m_glmodels) {
+            object->removeModel(model);
+        }
+    }
     else
         qWarning()<<"Warning: could not find GLItem to clear of models";
 }
@@ -2,6 +2,8 @@
 #define GLITEM_H
 
 #include <QQuickItem>
+#include <QMutex>
+#include "scenestore.h"
 
 
 class GLTransformNode;
@@ -14,6 +16,7 @@ class GLLight;
 class EnvParam;
 class Light;
 class Material;
+class Geometry;
 
 class GLItem : public QQuickItem
 {
@@ -24,7 +27,13 @@ class GLItem : public QQuickItem
     Q_PROPERTY(QQmlListProperty<GLMaterial> glmaterial READ glmaterial DESIGNABLE false FINAL)
     Q_PROPERTY(Status status READ status NOTIFY statusChanged)
     Q_PROPERTY(bool asynchronous READ asynchronous WRITE setAsynchronous NOTIFY asynchronousChanged)
+    Q_PROPERTY(bool progressive READ progressive WRITE setProgressive NOTIFY progressiveChanged)
+    Q_PROPERTY(bool compactVertex READ compactVertex WRITE setCompactVertex NOTIFY compactVertexChanged)
+    Q_PROPERTY(qreal lodBias READ lodBias WRITE setLodBias NOTIFY lodBiasChanged)
     Q_PROPERTY(GLEnvironment *environment READ environment WRITE setEnvironment NOTIFY environmentChanged)
+    Q_PROPERTY(int drawCalls READ drawCalls NOTIFY statisticsChanged)
+    Q_PROPERTY(int textureBinds READ textureBinds NOTIFY statisticsChanged)
+    Q_PROPERTY(int uniformUploads READ uniformUploads NOTIFY statisticsChanged)
     Q_CLASSINFO("DefaultProperty", "glnode")
 public:
     GLItem(QQuickItem *parent = 0);
@@ -41,16 +50,42 @@ public:
     bool asynchronous() const { return m_asynchronous; }
     void setAsynchronous(bool value);
 
+    // render each model as soon as it is loaded instead of waiting for
+    // all of them, textures show up when decoded
+    bool progressive() const { return m_progressive; }
+    void setProgressive(bool value);
+
+    bool compactVertex() const { return m_compact_vertex; }
+    void setCompactVertex(bool value);
+
+    // added to the mip level of all texture lookups, positive is blurrier
+    qreal lodBias() const { return m_lod_bias; }
+    void setLodBias(qreal value);
+
     GLEnvironment *environment() const { return m_environment; }
     void setEnvironment(GLEnvironment *value);
 
+    // counted over the last rendered frame
+    int drawCalls() const { return m_draw_calls; }
+    int textureBinds() const { return m_texture_binds; }
+    int uniformUploads() const { return m_uniform_uploads; }
+
     void componentComplete();
     void load();
 
+    // add or remove a model of a loaded item, only its geometry is
+    // uploaded or freed, the rest of the scene stays in place
+    Q_INVOKABLE void addModel(GLModel *model);
+    Q_INVOKABLE void removeModel(GLModel *model);
+
 signals:
     void statusChanged();
     void asynchronousChanged();
+    void progressiveChanged();
+    void compactVertexChanged();
+    void lodBiasChanged();
     void environmentChanged();
+    void statisticsChanged();
 
 public slots:
     void sync();
@@ -58,21 +93,56 @@ public slots:
     void updateWindow();
 
 private:
+    friend class ModelLoadTask;
+
     GLRender *m_render;
     GLTransformNode *m_root;
+    GLTransformNode *m_model_node;
+    // transforms of the nodes below m_root
+    SceneStore m_scene;
     Status m_status;
     bool m_asynchronous;
+    bool m_progressive;
+    bool m_compact_vertex;
+    qreal m_lod_bias;
     GLEnvironment *m_environment;
     EnvParam *m_envparam;
+    int m_draw_calls;
+    int m_texture_binds;
+    int m_uniform_uploads;
 
-    QVector<float> m_vertex;
-    QVector<ushort> m_index;
     QList<Light *> m_lights;
+    // lights made for GLLights no model light is named after
+    QHash<GLLight *, Light *> m_placeholder_lights;
     QList<Material *> m_materials;
-    bool m_has_texture_uv;
     int m_num_vertex;
-
-    bool loadEnvironmentImage(const QUrl &url, QImage &image);
+    int m_num_index;
+
+    // models loaded but not merged into the scene yet, from progressive
+    // loading or added at runtime
+    QMutex m_pending_mutex;
+    QList<GLModel *> m_pending;
+    int m_loading;
+    bool m_env_loaded;
+
+    // merged models whose geometry isn't uploaded yet
+    QList<GLModel *> m_uploads;
+    // removed models still to take out of the scene
+    QList<GLModel *> m_removed;
+    QHash<GLModel *, QList<Material *> > m_model_materials;
+
+    void modelLoaded(GLModel *md, bool ok);
+    void reveal();
+    void mergeModel(GLModel *md);
+    void unmergeModel(GLModel *md);
+    void replaceMaterials(GLModel *md);
+    void bindLights();
+    bool rebindLights(const QList<Light *> &lights);
+    void bindAnimateNodes(bool warn);
+    void uploadModels();
+    void removeModels();
+
+    void loadEnvironment();
     void replaceMaterial(GLTransformNode *node, Material *om, Material *nm);
 
     static int glnode_count(QQmlListProperty<GLAnimateNode> *list);
@@ -98,9 +168,6 @@ private:
     static GLMaterial *glmaterial_at(QQmlListProperty<GLMaterial> *list, int);
     static void glmaterial_clear(QQmlListProperty<GLMaterial> *list);
     QList<GLMaterial *> m_glmaterials;
-
-    bool bindAnimateNode(GLTransformNode *, GLAnimateNode *);
-    void calcModelviewMatrix(GLTransformNode *, const QMatrix4x4 &);
 };
 
 #endif // GLITEM_H
@@ -19,7 +19,20 @@ SOURCES += \
     glmodel.cpp \
     gljsonloadmodel.cpp \
     material.cpp \
-    gldatamodel.cpp
+    gldatamodel.cpp \
+    modelcache.cpp \
+    jsonstreamreader.cpp \
+    meshoptimizer.cpp \
+    compactvertex.cpp \
+    texture.cpp \
+    ktximage.cpp \
+    bufferallocator.cpp \
+    streambuffer.cpp \
+    drawlist.cpp \
+    scenestore.cpp \
+    affine3x4.cpp \
+    sharedmodel.cpp \
+    cubemap.cpp
 
 HEADERS += \
     glshader.h \
@@ -41,7 +54,21 @@ HEADERS += \
     mesh.h \
     light.h \
     renderstate.h \
-    gldatamodel.h
+    gldatamodel.h \
+    modelcache.h \
+    jsonstreamreader.h \
+    geometry.h \
+    meshoptimizer.h \
+    compactvertex.h \
+    texture.h \
+    ktximage.h \
+    bufferallocator.h \
+    streambuffer.h \
+    drawlist.h \
+    scenestore.h \
+    affine3x4.h \
+    sharedmodel.h \
+    cubemap.h
 
 CONFIG += link_pkgconfig
 PKGCONFIG += assimp
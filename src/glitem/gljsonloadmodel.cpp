@@ -1,10 +1,10 @@
 #include "gljsonloadmodel.h"
 #include "glmaterial.h"
 #include "glnode.h"
+#include "modelcache.h"
+#include "sharedmodel.h"
+#include "jsonstreamreader.h"
 #include <QFile>
-#include <QJsonDocument>
-#include <QJsonObject>
-#include <QJsonArray>
 #include <QHash>
 #include <QVector2D>
 #include <QVector3D>
@@ -12,7 +12,7 @@
 
 
 GLJSONLoadModel::GLJSONLoadModel(QObject *parent)
-    : GLModel(parent)
+    : GLModel(parent), m_cache(true)
 {
 
 }
@@ -25,6 +25,14 @@ void GLJSONLoadModel::setFile(const QUrl &value)
     }
 }
 
+void GLJSONLoadModel::setCache(bool value)
+{
+    if (m_cache != value) {
+        m_cache = value;
+        emit cacheChanged();
+    }
+}
+
 bool GLJSONLoadModel::load()
 {
     if (m_file.isEmpty())
@@ -34,52 +42,305 @@ bool GLJSONLoadModel::load()
     if (!urlToPath(m_file, path))
         return false;
 
+    Q_ASSERT(m_material);
+
+    if (name().isEmpty())
+        setName(m_file.fileName());
+
+    // optimized geometry is cached apart from the file order one
+    QString tag = optimize() ? "json-optimized" : "json";
+
+    bool loading;
+    QSharedPointer<SharedModel> shared =
+            SharedModel::acquire<SharedModel>(SharedModel::key(path, tag), loading);
+    if (!loading) {
+        // another model parses the same file
+        if (!shared->wait()) {
+            shared->releaseGeometry();
+            return false;
+        }
+        m_geometry = shared->geometry;
+        m_meshes = shared->meshes;
+    }
+    else {
+        ModelCache cache(path, tag);
+        if (!m_cache || !cache.open() || !readCache(cache)) {
+            release();
+            m_meshes.clear();
+
+            if (!parse(path)) {
+                shared->finish(false);
+                shared->releaseGeometry();
+                return false;
+            }
+
+            optimizeGeometry();
+
+            if (m_cache && cache.create()) {
+                writeCache(cache);
+                cache.commit();
+            }
+        }
+
+        shared->geometry = m_geometry;
+        shared->meshes = m_meshes;
+        shared->finish(true);
+    }
+    m_shared = shared;
+
+    for (int i = 0; i < m_meshes.size(); i++)
+        m_rnodes.append(new GLRenderNode(&m_meshes[i]));
+
+    return GLModel::load();
+}
+
+// face array source, either streamed from the reader or
+// buffered when faces come before the arrays they index
+class FaceStream
+{
+public:
+    // faces from the first one indexing an array not read yet are
+    // buffered in deferred
+    FaceStream(JsonStreamReader *reader, QVector<int> *deferred)
+        : m_reader(reader), m_buffer(0), m_deferred(deferred), m_pos(0), m_value(0),
+          m_pending(false), m_error(false)
+    {}
+
+    FaceStream(const QVector<int> *buffer)
+        : m_reader(0), m_buffer(buffer), m_deferred(0), m_pos(0), m_value(0),
+          m_pending(false), m_error(false)
+    {}
+
+    bool atEnd() {
+        if (m_buffer)
+            return m_pos >= m_buffer->size();
+
+        if (!m_pending) {
+            JsonStreamReader::Token token = m_reader->next();
+            if (token == JsonStreamReader::EndArray)
+                return true;
+            if (token != JsonStreamReader::Number) {
+                m_error = true;
+                return true;
+            }
+            m_value = int(m_reader->number());
+            m_pending = true;
+        }
+        return false;
+    }
+
+    int take() {
+        if (m_buffer) {
+            if (m_pos < m_buffer->size())
+                return m_buffer->at(m_pos++);
+            m_error = true;
+            return 0;
+        }
+
+        if (atEnd()) {
+            m_error = true;
+            return 0;
+        }
+        m_pending = false;
+        m_face.append(m_value);
+        return m_value;
+    }
+
+    // values of the current face are kept until the next one
+    void beginFace() { m_face.resize(0); }
+
+    // buffer the current face and the rest of the array, false when
+    // the faces are buffered already, the arrays are all read then
+    bool defer() {
+        if (!m_deferred)
+            return false;
+
+        *m_deferred += m_face;
+        while (!atEnd())
+            m_deferred->append(take());
+        return !m_error;
+    }
+
+    bool hasError() const { return m_error; }
+
+private:
+    JsonStreamReader *m_reader;
+    const QVector<int> *m_buffer;
+    QVector<int> *m_deferred;
+    QVector<int> m_face;
+    int m_pos;
+    int m_value;
+    bool m_pending;
+    bool m_error;
+};
+
+// position, uv and normal index of a welded vertex, -1 when missing
+struct WeldKey {
+    int position;
+    int uv;
+    int normal;
+};
+
+static inline bool operator==(const WeldKey &a, const WeldKey &b)
+{
+    return a.position == b.position && a.uv == b.uv && a.normal == b.normal;
+}
+
+static inline uint qHash(const WeldKey &key, uint seed = 0)
+{
+    return qHash((quint64(quint32(key.position)) << 32) | quint32(key.uv), seed) ^
+           qHash(key.normal, seed);
+}
+
+// vertices welded so far, faces without and with uv separately
+struct VertexLookup {
+    QHash<WeldKey, uint> plain;
+    QHash<WeldKey, uint> textured;
+};
+
+bool GLJSONLoadModel::parse(const QString &path)
+{
     QFile file(path);
     if (!file.open(QIODevice::ReadOnly)) {
         qWarning() << "can't open model file: " << path;
         return false;
     }
 
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &error);
-    if (error.error != QJsonParseError::NoError) {
-        qWarning() << "json file parse error: " << path << "|" << error.errorString();
+    JsonStreamReader reader(&file);
+    if (reader.next() != JsonStreamReader::BeginObject) {
+        qWarning() << "json file format error: " << path << "|not object";
         return false;
     }
 
-    if (!doc.isObject()) {
-        qWarning() << "json file format error: " << path << "|not object";
+    float scale = 1.0;
+    int nvertices = 1024, nfaces = 1024;
+    QVector<float> va, na, ta;
+    QVector<int> fa;
+    QVector<uint> index, textured_index;
+    VertexLookup lookup;
+
+    JsonStreamReader::Token token;
+    while ((token = reader.next()) == JsonStreamReader::String) {
+        QByteArray key = reader.string();
+        if (key == "scale") {
+            if (reader.next() != JsonStreamReader::Number)
+                break;
+            if (reader.number() != 0)
+                scale = 1.0 / reader.number();
+        }
+        else if (key == "metadata") {
+            if (reader.next() != JsonStreamReader::BeginObject)
+                break;
+            while ((token = reader.next()) == JsonStreamReader::String) {
+                QByteArray mkey = reader.string();
+                token = reader.next();
+                if (mkey == "vertices" && token == JsonStreamReader::Number)
+                    nvertices = int(reader.number());
+                else if (mkey == "triangles" && token == JsonStreamReader::Number)
+                    nfaces = int(reader.number());
+                else if (!reader.skip(token))
+                    break;
+            }
+            if (token != JsonStreamReader::EndObject)
+                break;
+
+            va.reserve(nvertices * 3);
+            na.reserve(nvertices * 3);
+        }
+        else if (key == "vertices") {
+            if (!reader.readNumbers(va))
+                break;
+        }
+        else if (key == "normals") {
+            if (!reader.readNumbers(na))
+                break;
+        }
+        else if (key == "uvs") {
+            if (reader.next() != JsonStreamReader::BeginArray)
+                break;
+            // now only support one uv channel
+            int channel = 0;
+            while ((token = reader.next()) == JsonStreamReader::BeginArray) {
+                if (channel++ == 0) {
+                    if (!reader.readNumbers(token, ta))
+                        break;
+                }
+                else if (!reader.skip(token))
+                    break;
+            }
+            if (token != JsonStreamReader::EndArray)
+                break;
+        }
+        else if (key == "faces") {
+            if (reader.next() != JsonStreamReader::BeginArray)
+                break;
+
+            // streamed as long as the arrays the faces index are read
+            m_geometry.reserve(nvertices, nfaces * 3);
+            FaceStream faces(&reader, &fa);
+            if (!parseFaces(faces, va, na, ta, lookup, index, textured_index))
+                break;
+        }
+        else if (!reader.skip(reader.next()))
+            break;
+    }
+
+    if (token != JsonStreamReader::EndObject || reader.hasError()) {
+        qWarning() << "json file parse error: " << path << "|at offset" << reader.offset();
         return false;
     }
 
-    QJsonObject json = doc.object();
-    float scale = 1.0 / json.value("scale").toDouble(1.0);
-
-    QJsonObject meta = json.value("metadata").toObject();
-    QJsonArray va = json.value("vertices").toArray();
-    QJsonArray na = json.value("normals").toArray();
-    QJsonArray ta = json.value("uvs").toArray();
-    QJsonArray fa = json.value("faces").toArray();
-
-    // now only support one uv channel
-    Q_ASSERT(ta.count() == 1);
-    ta = ta[0].toArray();
-
-    int nvertices = meta.value("vertices").toInt(1024);
-    int nfaces = meta.value("triangles").toInt(1024);
-    m_vertex.reserve(nvertices * 3);
-    m_index.reserve(nfaces * 3);
-    m_textured_vertex.reserve(nvertices * 3);
-    m_textured_vertex_uv.reserve(nvertices * 3);
-    m_textured_index.reserve(nfaces * 3);
-
-    typedef QHash<u_int64_t, ushort> VertexMap;
-
-    int i = 0;
-    int vi = 0, tvi = 0;
-    VertexMap vertex_lookup, textured_vertex_lookup;
-    while (i < fa.count()) {
-        int type = fa[i++].toInt();
+    if (!fa.isEmpty()) {
+        FaceStream faces(&fa);
+        if (!parseFaces(faces, va, na, ta, lookup, index, textured_index)) {
+            qWarning() << "json file format error: " << path << "|invalid faces";
+            return false;
+        }
+    }
+
+    if (scale != 1.0) {
+        Vertex *vertex = m_geometry.vertices();
+        for (int i = 0; i < m_geometry.vertexCount(); i++) {
+            vertex[i].position[0] *= scale;
+            vertex[i].position[1] *= scale;
+            vertex[i].position[2] *= scale;
+        }
+    }
+
+    // faces without uv first, then textured ones, one mesh each
+    if (!index.isEmpty()) {
+        Mesh mesh;
+        mesh.type = Mesh::NORMAL;
+        mesh.index_offset = m_geometry.indexCount();
+        mesh.index_count = index.size();
+        memcpy(m_geometry.addIndices(index.size()), index.constData(), index.size() * sizeof(uint));
+        m_meshes.append(mesh);
+    }
+
+    if (!textured_index.isEmpty()) {
+        Mesh mesh;
+        mesh.type = Mesh::TEXTURED;
+        mesh.index_offset = m_geometry.indexCount();
+        mesh.index_count = textured_index.size();
+        memcpy(m_geometry.addIndices(textured_index.size()), textured_index.constData(),
+               textured_index.size() * sizeof(uint));
+        m_meshes.append(mesh);
+    }
+
+    return true;
+}
+
+bool GLJSONLoadModel::parseFaces(FaceStream &faces, const QVector<float> &va,
+                                 const QVector<float> &na, const QVector<float> &ta,
+                                 VertexLookup &lookup,
+                                 QVector<uint> &index, QVector<uint> &textured_index)
+{
+    typedef QHash<WeldKey, uint> VertexMap;
+
+    int nva = va.size() / 3, nna = na.size() / 3, nta = ta.size() / 2;
+    while (!faces.atEnd()) {
+        faces.beginFace();
+        int type = faces.take();
         bool isQuad              = type & (1 << 0);
         bool hasMaterial         = type & (1 << 1);
         bool hasFaceVertexUv     = type & (1 << 3);
@@ -88,54 +349,65 @@ bool GLJSONLoadModel::load()
         bool hasFaceColor        = type & (1 << 6);
         bool hasFaceVertexColor  = type & (1 << 7);
 
+        // the arrays may come after the faces in the file
+        if (!nva || (hasFaceVertexUv && !nta) ||
+            ((hasFaceNormal || hasFaceVertexNormal) && !nna))
+            return faces.defer();
+
         int nov;
         if (isQuad)
             nov = 4;
         else
             nov = 3;
 
-        u_int64_t key[nov];
+        WeldKey key[4];
 
-        QVector3D v[nov];
+        QVector3D v[4];
         for (int j = 0; j < nov; j++) {
-            int k = fa[i++].toInt();
-            key[j] = k;
-
-            v[j].setX(va[k * 3 + 0].toDouble() * scale);
-            v[j].setY(va[k * 3 + 1].toDouble() * scale);
-            v[j].setZ(va[k * 3 + 2].toDouble() * scale);
+            int k = faces.take();
+            if (k < 0 || k >= nva)
+                return false;
+            key[j].position = k;
+            key[j].uv = -1;
+            key[j].normal = -1;
+
+            v[j].setX(va[k * 3 + 0]);
+            v[j].setY(va[k * 3 + 1]);
+            v[j].setZ(va[k * 3 + 2]);
         }
 
         // now we drop the material
-        if (hasMaterial) i++;
+        if (hasMaterial) faces.take();
 
-        QVector2D t[nov];
+        QVector2D t[4];
         if (hasFaceVertexUv) {
             for (int j = 0; j < nov; j++) {
-                int k = fa[i++].toInt();
-                key[j] <<= 16;
-                key[j] |= k;
+                int k = faces.take();
+                if (k < 0 || k >= nta)
+                    return false;
+                key[j].uv = k;
 
-                t[j].setX(ta[k * 2 + 0].toDouble());
-                t[j].setY(ta[k * 2 + 1].toDouble());
+                t[j].setX(ta[k * 2 + 0]);
+                t[j].setY(ta[k * 2 + 1]);
             }
         }
 
-        QVector3D n[nov];
+        QVector3D n[4];
         if (hasFaceNormal) {
             // vertex normal overwrite face normal
             if (hasFaceVertexNormal)
-                i++;
+                faces.take();
             else {
-                int k = fa[i++].toInt();
+                int k = faces.take();
+                if (k < 0 || k >= nna)
+                    return false;
                 QVector3D nn(
-                    na[k * 3 + 0].toDouble(),
-                    na[k * 3 + 1].toDouble(),
-                    na[k * 3 + 2].toDouble()
+                    na[k * 3 + 0],
+                    na[k * 3 + 1],
+                    na[k * 3 + 2]
                 );
                 for (int j = 0; j < nov; j++) {
-                    key[j] <<= 16;
-                    key[j] |= k;
+                    key[j].normal = k;
 
                     n[j] = nn;
                 }
@@ -144,58 +416,52 @@ bool GLJSONLoadModel::load()
 
         if (hasFaceVertexNormal) {
             for (int j = 0; j < nov; j++) {
-                int k = fa[i++].toInt();
-                key[j] <<= 16;
-                key[j] |= k;
-
-                n[j].setX(na[k * 3 + 0].toDouble());
-                n[j].setY(na[k * 3 + 1].toDouble());
-                n[j].setZ(na[k * 3 + 2].toDouble());
+                int k = faces.take();
+                if (k < 0 || k >= nna)
+                    return false;
+                key[j].normal = k;
+
+                n[j].setX(na[k * 3 + 0]);
+                n[j].setY(na[k * 3 + 1]);
+                n[j].setZ(na[k * 3 + 2]);
             }
         }
 
-        /*
-        if (!hasFaceNormal && !hasFaceVertexNormal) {
-            QVector3D nn = QVector3D::normal(v[0], v[1], v[2]);
-            for (int j = 0; j < nov; j++)
-                n[j] = nn;
-        }
-        */
         Q_ASSERT(hasFaceNormal || hasFaceVertexNormal);
 
         if (hasFaceColor)
-            i++;
+            faces.take();
 
         if (hasFaceVertexColor)
-            i += nov;
+            for (int j = 0; j < nov; j++)
+                faces.take();
+
+        if (faces.hasError())
+            return false;
 
-        int *pvi;
-        ushort tia[nov];
+        uint tia[4];
         VertexMap *plookup;
-        QList<float> *pvv;
-        QList<ushort> *piv;
+        QVector<uint> *piv;
         if (hasFaceVertexUv) {
-            plookup = &textured_vertex_lookup;
-            pvv = &m_textured_vertex;
-            piv = &m_textured_index;
-            pvi = &tvi;
+            plookup = &lookup.textured;
+            piv = &textured_index;
         }
         else {
-            plookup = &vertex_lookup;
-            pvv = &m_vertex;
-            piv = &m_index;
-            pvi = &vi;
+            plookup = &lookup.plain;
+            piv = &index;
         }
 
         for (int j = 0; j < nov; j++) {
             VertexMap::iterator it = plookup->find(key[j]);
             if (it == plookup->end()) {
-                tia[j] = *pvi;
-                plookup->insert(key[j], (*pvi)++);
-                appendVector(pvv, v[j]);
-                appendVector(pvv, n[j]);
+                tia[j] = m_geometry.vertexCount();
+                plookup->insert(key[j], tia[j]);
+
+                Vertex &vertex = m_geometry.addVertex();
+                assign(vertex.position, v[j]);
+                assign(vertex.normal, n[j]);
                 if (hasFaceVertexUv)
-                    appendVector(&m_textured_vertex_uv, t[j]);
+                    assign(vertex.uv, t[j]);
             }
             else
                 tia[j] = it.value();
@@ -217,46 +483,19 @@ bool GLJSONLoadModel::load()
         }
     }
 
-    Q_ASSERT(m_material);
-
-    int nmeshes = 0;
-    if (!m_index.isEmpty()) {
-        m_meshes.resize(nmeshes + 1);
-
-        m_meshes[nmeshes].type = Mesh::NORMAL;
-        m_meshes[nmeshes].index_offset = 0;
-        m_meshes[nmeshes].index_count = m_index.size();
-
-        m_rnodes.append(new GLRenderNode(&m_meshes[nmeshes]));
-        nmeshes++;
-    }
-
-    if (!m_textured_index.isEmpty()) {
-        m_meshes.resize(nmeshes + 1);
-
-        m_meshes[nmeshes].type = Mesh::TEXTURED;
-        m_meshes[nmeshes].index_offset = 0;
-        m_meshes[nmeshes].index_count = m_textured_index.size();
-
-        m_rnodes.append(new GLRenderNode(&m_meshes[nmeshes]));
-    }
-
-    if (name().isEmpty())
-        setName(m_file.fileName());
-
-    return GLModel::load();
+    return !faces.hasError();
 }
 
-void GLJSONLoadModel::appendVector(QList<float> *vector, QVector2D &value)
+void GLJSONLoadModel::assign(float *vector, const QVector2D &value)
 {
-    vector->append(value.x());
-    vector->append(value.y());
+    vector[0] = value.x();
+    vector[1] = value.y();
 }
 
-void GLJSONLoadModel::appendVector(QList<float> *vector, QVector3D &value)
+void GLJSONLoadModel::assign(float *vector, const QVector3D &value)
 {
-    vector->append(value.x());
-    vector->append(value.y());
-    vector->append(value.z());
+    vector[0] = value.x();
+    vector[1] = value.y();
+    vector[2] = value.z();
 }
 
@@ -4,26 +4,41 @@
 #include "glmodel.h"
 #include <QUrl>
 
+class FaceStream;
+struct VertexLookup;
+
 class GLJSONLoadModel : public GLModel
 {
     Q_OBJECT
     Q_PROPERTY(QUrl file READ file WRITE setFile NOTIFY fileChanged)
+    Q_PROPERTY(bool cache READ cache WRITE setCache NOTIFY cacheChanged)
 public:
     GLJSONLoadModel(QObject *parent = 0);
 
     QUrl file() { return m_file; }
     void setFile(const QUrl &value);
 
+    bool cache() { return m_cache; }
+    void setCache(bool value);
+
     virtual bool load();
 
 signals:
     void fileChanged();
+    void cacheChanged();
 
 private:
     QUrl m_file;
+    bool m_cache;
+
+    bool parse(const QString &path);
+    bool parseFaces(FaceStream &faces, const QVector<float> &va,
+                    const QVector<float> &na, const QVector<float> &ta,
+                    VertexLookup &lookup,
+                    QVector<uint> &index, QVector<uint> &textured_index);
 
-    void appendVector(QList<float> *vector, QVector2D &value);
-    void appendVector(QList<float> *vector, QVector3D &value);
+    static void assign(float *vector, const QVector2D &value);
+    static void assign(float *vector, const QVector3D &value);
 };
 
 #endif // GLJSONLOADMODEL_H
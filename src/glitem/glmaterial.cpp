@@ -4,7 +4,8 @@
 
 
 GLMaterial::GLMaterial(QObject *parent)
-    : QObject(parent), m_material(0), m_transparent(false), m_opacity(1)
+    : QObject(parent), m_material(0), m_transparent(false), m_opacity(1),
+      m_filter(Trilinear), m_anisotropy(8)
 {
 
 }
@@ -33,6 +34,22 @@ void GLMaterial::setOpacity(qreal value)
     }
 }
 
+void GLMaterial::setFilter(Filter value)
+{
+    if (m_filter != value) {
+        m_filter = value;
+        emit filterChanged();
+    }
+}
+
+void GLMaterial::setAnisotropy(qreal value)
+{
+    if (m_anisotropy != value) {
+        m_anisotropy = value;
+        emit anisotropyChanged();
+    }
+}
+
 bool GLMaterial::urlToPath(const QUrl &url, QString &path)
 {
     if (url.scheme() == "file")
@@ -44,6 +61,11 @@ bool GLMaterial::urlToPath(const QUrl &url, QString &path)
     return true;
 }
 
+void GLMaterial::initTextureFilter(Material *material)
+{
+    material->setTextureFilter(static_cast<Texture::Filter>(m_filter), float(m_anisotropy));
+}
+
 Material *GLMaterial::material()
 {
     if (m_material) {
@@ -72,6 +94,7 @@ Material *GLBasicMaterial::material()
 {
     if (!m_material) {
         BasicMaterial *bm = new BasicMaterial();
+        initTextureFilter(bm);
         QString path;
         if (urlToPath(m_map, path))
             bm->loadTexture(path, QOpenGLTexture::ClampToEdge);
@@ -157,6 +180,8 @@ Material *GLPhongMaterial::material()
         if (m_env_map)
             pm->setEnvMap(m_reflectivity);
 
+        initTextureFilter(pm);
+
         QString path;
         if (urlToPath(m_map, path))
             pm->loadDiffuseTexture(path, QOpenGLTexture::ClampToEdge);
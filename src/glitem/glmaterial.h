@@ -15,9 +15,15 @@ class GLMaterial : public QObject
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
     Q_PROPERTY(bool transparent READ transparent WRITE setTransparent NOTIFY transparentChanged)
     Q_PROPERTY(qreal opacity READ opacity WRITE setOpacity NOTIFY opacityChanged)
+    Q_PROPERTY(Filter filter READ filter WRITE setFilter NOTIFY filterChanged)
+    Q_PROPERTY(qreal anisotropy READ anisotropy WRITE setAnisotropy NOTIFY anisotropyChanged)
+    Q_ENUMS(Filter)
 public:
     GLMaterial(QObject *parent = 0);
 
+    // same values as Texture::Filter
+    enum Filter { Linear, Trilinear, Anisotropic };
+
     QString name() { return m_name; }
     void setName(const QString &value);
 
@@ -27,22 +33,37 @@ public:
     qreal opacity() { return m_opacity; }
     void setOpacity(qreal value);
 
+    Filter filter() { return m_filter; }
+    void setFilter(Filter value);
+
+    // maximum degree of anisotropy when filter is Anisotropic
+    qreal anisotropy() { return m_anisotropy; }
+    void setAnisotropy(qreal value);
+
     virtual Material *material();
+    // what material() returned last, without updating it, for loader
+    // threads sharing this with other models
+    Material *loadedMaterial() const { return m_material; }
 
 signals:
     void nameChanged();
     void transparentChanged();
     void opacityChanged();
+    void filterChanged();
+    void anisotropyChanged();
 
 protected:
     Material *m_material;
 
     bool urlToPath(const QUrl &url, QString &path);
+    void initTextureFilter(Material *material);
 
 private:
     QString m_name;
     bool m_transparent;
     qreal m_opacity;
+    Filter m_filter;
+    qreal m_anisotropy;
 };
 
 class GLBasicMaterial : public GLMaterial
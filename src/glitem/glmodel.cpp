@@ -1,13 +1,17 @@
 #include "glmodel.h"
 #include "glnode.h"
 #include "glmaterial.h"
+#include "modelcache.h"
+#include "meshoptimizer.h"
+#include "sharedmodel.h"
 #include <QUrl>
 #include <QDebug>
 
 
 GLModel::GLModel(QObject *parent)
     : QObject(parent), m_material(0), m_root(0), m_node(0),
-      m_visible(true), m_visible_dirty(false), m_material_dirty(false)
+      m_visible(true), m_visible_dirty(false), m_optimize(false),
+      m_material_dirty(false), m_status(Null)
 {
 
 }
@@ -48,19 +52,50 @@ void GLModel::setVisible(bool value)
     }
 }
 
-void GLModel::release()
+void GLModel::setOptimize(bool value)
+{
+    if (m_optimize != value) {
+        m_optimize = value;
+        emit optimizeChanged();
+    }
+}
+
+void GLModel::setStatus(Status value)
 {
-    m_vertex.clear();
-    m_index.clear();
+    if (m_status != value) {
+        m_status = value;
+        emit statusChanged();
+    }
+}
 
-    m_textured_vertex.clear();
-    m_textured_vertex_uv.clear();
-    m_textured_index.clear();
+void GLModel::release()
+{
+    m_geometry.clear();
+    if (m_shared) {
+        m_shared->releaseGeometry();
+        m_shared.clear();
+    }
 
     m_materials.clear();
     m_lights.clear();
 }
 
+bool GLModel::takeVertices(QVector<Vertex> &, int &)
+{
+    return false;
+}
+
+void GLModel::unload()
+{
+    release();
+
+    m_meshes.clear();
+    m_tnodes.clear();
+    m_rnodes.clear();
+    m_root = 0;
+    setStatus(Null);
+}
+
 bool GLModel::load()
 {
     if (!m_node) {
@@ -102,8 +137,58 @@ bool GLModel::urlToPath(const QUrl &url, QString &path)
     return true;
 }
 
-void GLModel::sync()
+bool GLModel::readCache(ModelCache &cache)
 {
+    int nmeshes;
+    if (!cache.read(m_geometry.vertexArray()) ||
+        !cache.read(m_geometry.indexArray()) ||
+        !cache.readInt(nmeshes))
+        return false;
+
+    m_meshes.resize(nmeshes);
+    for (int i = 0; i < nmeshes; i++) {
+        int type;
+        if (!cache.readInt(type) ||
+            !cache.readInt(m_meshes[i].index_offset) ||
+            !cache.readInt(m_meshes[i].index_count))
+            return false;
+        m_meshes[i].type = (Mesh::Type)type;
+    }
+
+    return true;
+}
+
+void GLModel::writeCache(ModelCache &cache)
+{
+    cache.write(m_geometry.vertexArray());
+    cache.write(m_geometry.indexArray());
+
+    cache.writeInt(m_meshes.size());
+    for (int i = 0; i < m_meshes.size(); i++) {
+        cache.writeInt(m_meshes[i].type);
+        cache.writeInt(m_meshes[i].index_offset);
+        cache.writeInt(m_meshes[i].index_count);
+    }
+}
+
+void GLModel::optimizeGeometry()
+{
+    if (!m_optimize)
+        return;
+
+    float before = MeshOptimizer::acmr(m_geometry.indices(), m_geometry.indexCount(),
+                                       m_geometry.vertexCount());
+    MeshOptimizer::optimize(m_geometry, m_meshes);
+    float after = MeshOptimizer::acmr(m_geometry.indices(), m_geometry.indexCount(),
+                                      m_geometry.vertexCount());
+
+    qDebug() << "model" << m_name << "ACMR" << before << "->" << after;
+}
+
+bool GLModel::sync()
+{
+    bool changed = m_visible_dirty || (m_material_dirty && m_material);
+
     if (m_visible_dirty) {
         foreach (GLTransformNode *tnode, m_tnodes) {
             tnode->setVisible(m_visible);
@@ -129,6 +214,8 @@ void GLModel::sync()
 
         m_material_dirty = false;
     }
+
+    return changed;
 }
 
 void GLModel::updateMaterial(GLTransformNode *n)
@@ -4,7 +4,9 @@
 #include <QObject>
 #include <QList>
 #include <QVector>
+#include <QSharedPointer>
 #include "mesh.h"
+#include "geometry.h"
 
 class GLMaterial;
 class GLTransformNode;
@@ -12,6 +14,8 @@ class GLRenderNode;
 class GLRenderNode;
 class Light;
 class Material;
+class ModelCache;
+class SharedModel;
 
 class GLModel : public QObject
 {
@@ -20,6 +24,9 @@ class GLModel : public QObject
     Q_PROPERTY(GLMaterial *material READ material WRITE setMaterial NOTIFY materialChanged)
     Q_PROPERTY(int node READ node WRITE setNode NOTIFY nodeChanged)
     Q_PROPERTY(bool visible READ visible WRITE setVisible NOTIFY visibleChanged)
+    Q_PROPERTY(bool optimize READ optimize WRITE setOptimize NOTIFY optimizeChanged)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_ENUMS(Status)
 public:
     GLModel(QObject *parent = 0);
 
@@ -35,21 +42,35 @@ public:
     bool visible() { return m_visible; }
     void setVisible(bool value);
 
-    QList<float> &vertex() { return m_vertex; }
-    QList<ushort> &index() { return m_index; }
-    QList<float> &texturedVertex() { return m_textured_vertex; }
-    QList<float> &texturedVertexUV() { return m_textured_vertex_uv; }
-    QList<ushort> &texturedIndex() { return m_textured_index; }
+    bool optimize() { return m_optimize; }
+    void setOptimize(bool value);
+
+    // Ready once the model is part of the rendered scene
+    enum Status { Null, Ready, Loading, Error };
+    Status status() const { return m_status; }
+    void setStatus(Status value);
+
+    Geometry &geometry() { return m_geometry; }
 
     QVector<Mesh> &meshes() { return m_meshes; }
     QList<Material *> &materials() { return m_materials; }
     QList<Light *> &lights() { return m_lights; }
     QList<GLTransformNode *> &tnodes() { return m_tnodes; }
     QList<GLRenderNode *> &rnodes() { return m_rnodes; }
+    // loader output of the file, null when it isn't shared
+    const QSharedPointer<SharedModel> &shared() const { return m_shared; }
 
     virtual bool load();
     virtual void release();
-    virtual void sync();
+    // vertices of dynamic models change after loading, they are kept
+    // out of the scene buffers and streamed with takeVertices()
+    virtual bool dynamic() { return false; }
+    // vertices changed since the last call, from the first changed one
+    virtual bool takeVertices(QVector<Vertex> &vertices, int &first);
+    // forget what the last load made, its nodes are deleted by the scene
+    virtual void unload();
+    // true when node visibility or materials changed
+    virtual bool sync();
 
 signals:
     void modelChanged();
@@ -57,32 +78,40 @@ signals:
     void materialChanged();
     void nodeChanged();
     void visibleChanged();
+    void optimizeChanged();
+    void statusChanged();
 
 protected:
     GLMaterial *m_material;
 
-    QList<float> m_vertex;
-    QList<ushort> m_index;
-    QList<float> m_textured_vertex;
-    QList<float> m_textured_vertex_uv;
-    QList<ushort> m_textured_index;
+    Geometry m_geometry;
 
     QVector<Mesh> m_meshes;
     QList<Material *> m_materials;
     QList<Light *> m_lights;
     GLTransformNode *m_root;
+    // loader output shared with other models, held until release()
+    QSharedPointer<SharedModel> m_shared;
 
     QList<GLTransformNode *> m_tnodes;
     QList<GLRenderNode *> m_rnodes;
 
     bool urlToPath(const QUrl &url, QString &path);
 
+    bool readCache(ModelCache &cache);
+    void writeCache(ModelCache &cache);
+
+    // reorder loaded geometry for the vertex caches when optimize is set
+    void optimizeGeometry();
+
 private:
     QString m_name;
     int m_node;
     bool m_visible;
     bool m_visible_dirty;
+    bool m_optimize;
     bool m_material_dirty;
+    Status m_status;
 
     void updateMaterial(GLTransformNode *);
 };
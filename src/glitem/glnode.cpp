@@ -1,9 +1,13 @@
 #include "glnode.h"
+#include "glanimatenode.h"
 
 
 GLTransformNode::GLTransformNode(const QString &name, const QMatrix4x4 &transform)
     : GLNode(), m_transform(transform), m_modelview_matrix(),
-      m_animate_node(0), m_name(name)
+      m_animate_node(0), m_name(name),
+      m_dirty(true), m_revision(0), m_normal_revision(-1),
+      m_combined_revision(-1), m_combined_projection(-1),
+      m_store(0), m_index(-1)
 {
 
 }
@@ -17,4 +21,49 @@ GLTransformNode::~GLTransformNode()
     foreach (GLTransformNode *node, m_transform_children) {
         removeChild(node);
     }
+
+    if (m_store)
+        m_store->release(m_index);
+}
+
+void GLTransformNode::setAnimateNode(GLAnimateNode *node)
+{
+    if (m_animate_node == node)
+        return;
+
+    m_animate_node = node;
+    if (m_store)
+        m_store->setAnimateNode(m_index, node);
+    else
+        m_dirty = true;
+}
+
+void GLTransformNode::setDirty()
+{
+    if (m_store)
+        m_store->setDirty(m_index);
+    else
+        m_dirty = true;
+}
+
+const QMatrix3x3 &GLTransformNode::normalMatrix()
+{
+    int rev = revision();
+    if (m_normal_revision != rev) {
+        m_normal_matrix = m_store ? m_store->affine(m_index).normalMatrix()
+                                  : m_modelview_matrix.normalMatrix();
+        m_normal_revision = rev;
+    }
+    return m_normal_matrix;
+}
+
+const QMatrix4x4 &GLTransformNode::combinedMatrix(const QMatrix4x4 &projection, int projection_serial)
+{
+    int rev = revision();
+    if (m_combined_revision != rev || m_combined_projection != projection_serial) {
+        m_combined_matrix = projection * modelviewMatrix();
+        m_combined_revision = rev;
+        m_combined_projection = projection_serial;
+    }
+    return m_combined_matrix;
 }
@@ -2,6 +2,7 @@
 #define GLNODE_H
 
 #include "glanimatenode.h"
+#include "scenestore.h"
 #include <QList>
 #include <QMatrix4x4>
 
@@ -54,6 +55,9 @@ public:
     void addChild(GLTransformNode *node) {
         m_transform_children.append(node);
         node->incRef();
+        node->setDirty();
+        if (m_store)
+            m_store->invalidate();
     }
 
     void addChild(QList<GLRenderNode *> &nodes) {
@@ -67,7 +71,10 @@ public:
         m_transform_children.append(nodes);
         foreach (GLTransformNode *node, nodes) {
             node->incRef();
+            node->setDirty();
         }
+        if (m_store)
+            m_store->invalidate();
     }
 
     void removeChild(GLRenderNode *node) {
@@ -78,29 +85,52 @@ public:
 
     void removeChild(GLTransformNode *node) {
         m_transform_children.removeAll(node);
+        if (m_store)
+            m_store->invalidate();
         if (!node->decRef())
             delete node;
     }
 
-    QMatrix4x4 &transformMatrix() { return m_transform; }
-    QMatrix4x4 &modelviewMatrix() { return m_modelview_matrix; }
+    // kept in the scene store while bound to one
+    const QMatrix4x4 &modelviewMatrix() { return m_store ? m_store->world(m_index) : m_modelview_matrix; }
 
     QList<GLRenderNode *> &renderChildren() { return m_render_children; }
     QList<GLTransformNode *> &transformChildren() { return m_transform_children; }
 
     GLAnimateNode *animateNode() { return m_animate_node; }
-    void setAnimateNode(GLAnimateNode *node) { m_animate_node = node; }
+    void setAnimateNode(GLAnimateNode *node);
+
+    // the modelview matrix of a dirty node and its subtree is computed
+    // again at the next scene store update
+    bool isDirty() const { return m_store ? m_store->isDirty(m_index) : m_dirty; }
+    void setDirty();
+    // bumped each time the modelview matrix is computed again
+    int revision() const { return m_store ? m_store->revision(m_index) : m_revision; }
+    // both cached until the modelview matrix or projection changes
+    const QMatrix3x3 &normalMatrix();
+    const QMatrix4x4 &combinedMatrix(const QMatrix4x4 &projection, int projection_serial);
 
     const QString &name() { return m_name; }
     void setName(const QString &value) { m_name = value; }
 
 private:
+    friend class SceneStore;
+
     QList<GLRenderNode *> m_render_children;
     QList<GLTransformNode *> m_transform_children;
     QMatrix4x4 m_transform;
     QMatrix4x4 m_modelview_matrix;
+    QMatrix3x3 m_normal_matrix;
+    QMatrix4x4 m_combined_matrix;
     GLAnimateNode *m_animate_node;
     QString m_name;
+    bool m_dirty;
+    int m_revision;
+    int m_normal_revision;
+    int m_combined_revision;
+    int m_combined_projection;
+    SceneStore *m_store;
+    int m_index;
 };
 
 #endif // GLNODE_H
@@ -3,38 +3,76 @@
 #include "glnode.h"
 #include "glenvironment.h"
 #include "material.h"
+#include "mesh.h"
+#include "geometry.h"
+#include "compactvertex.h"
+#include "texture.h"
+#include "ktximage.h"
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#endif
+#ifndef GL_COPY_WRITE_BUFFER
+#define GL_COPY_WRITE_BUFFER 0x8F37
+#endif
 
 
 GLRender::GLRender(RenderParam *param)
     : m_root(param->root),
-      m_has_texture_uv(param->has_texture_uv),
-      m_num_vertex(param->num_vertex),
+      m_compact_vertex(param->compact_vertex),
       m_materials(param->materials),
+      m_lights(param->lights),
       m_vertex_buffer(QOpenGLBuffer::VertexBuffer),
       m_index_buffer(QOpenGLBuffer::IndexBuffer),
-      m_use_vao(false)
+      m_copy_buffer(0), m_uint_index(false), m_use_vao(false)
 {
     initializeOpenGLFunctions();
     //printOpenGLInfo();
 
-    // init lights
-    m_state.lights.resize(param->lights->size());
-    for (int i = 0; i < param->lights->size(); i++)
-        m_state.lights[i].light = param->lights->at(i);
+    initLights();
+
+    m_state.lod_bias = 0;
+    m_state.projection_serial = RenderState::nextSerial();
+    m_state.statistics = RenderState::Statistics();
 
     EnvParam *env = param->env;
     m_state.envmap = 0;
-    if (env) {
+    if (env && !initCompressedEnvTexture(env)) {
+        // KTX faces the context can't sample compressed are decoded
+        QImage *faces[6] = {
+            &env->right, &env->left, &env->top, &env->bottom, &env->back, &env->front
+        };
+        for (int i = 0; i < 6; i++) {
+            if (env->ktx[i])
+                *faces[i] = env->ktx[i]->decode();
+        }
+
         m_state.envmap = new QOpenGLTexture(QOpenGLTexture::TargetCubeMap);
         m_state.envmap->setSize(env->width, env->height);
-        if (QOpenGLContext::currentContext()->isOpenGLES())
+        // faces are 8-bit, store them as they are
+        QOpenGLContext *context = QOpenGLContext::currentContext();
+        if (context->isOpenGLES() && context->format().majorVersion() < 3)
             m_state.envmap->setFormat(QOpenGLTexture::RGBAFormat);
+        else if (env->srgb)
+            m_state.envmap->setFormat(QOpenGLTexture::SRGB8_Alpha8);
         else
-            m_state.envmap->setFormat(QOpenGLTexture::RGBA32F);
+            m_state.envmap->setFormat(QOpenGLTexture::RGBA8_UNorm);
         m_state.envmap->setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::ClampToEdge);
         m_state.envmap->setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
         //m_state.envmap->setWrapMode(QOpenGLTexture::DirectionR, QOpenGLTexture::ClampToEdge);
-        m_state.envmap->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+        bool mipmapped = Texture::canMipmap(env->width, env->height);
+        if (mipmapped) {
+            m_state.envmap->setMipLevels(m_state.envmap->maximumMipLevels());
+            m_state.envmap->setMinMagFilters(QOpenGLTexture::LinearMipMapLinear, QOpenGLTexture::Linear);
+        }
+        else
+            m_state.envmap->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
         m_state.envmap->allocateStorage();
 
         QSize size(env->width, env->height);
@@ -47,25 +85,56 @@ GLRender::GLRender(RenderParam *param)
             delete m_state.envmap;
             m_state.envmap = 0;
         }
+        else if (mipmapped)
+            m_state.envmap->generateMipMaps();
     }
 
     // mark all states dirty
     m_state.setDirty();
 
     // init primitives
+    if (m_compact_vertex && !initCompactVertexLayout()) {
+        qDebug() << "OpenGL has no half float vertex attribute, use full size vertex";
+        m_compact_vertex = false;
+    }
+    if (!m_compact_vertex)
+        initVertexLayout();
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    m_uint_index = !context->isOpenGLES() ||
+                   context->format().majorVersion() >= 3 ||
+                   context->hasExtension("GL_OES_element_index_uint");
+    if (param->max_model_vertex > USHRT_MAX + 1 && m_uint_index) {
+        m_state.index_type = GL_UNSIGNED_INT;
+        m_state.index_size = sizeof(uint);
+    }
+    else {
+        // indices are relative to their model, 16 bits are enough
+        // unless a model is larger
+        m_state.index_type = GL_UNSIGNED_SHORT;
+        m_state.index_size = sizeof(ushort);
+    }
+
+    // without buffer copies the uploaded data is kept to move it
+    if ((!context->isOpenGLES() && context->format().version() >= qMakePair(3, 1)) ||
+        (context->isOpenGLES() && context->format().majorVersion() >= 3) ||
+        context->hasExtension("GL_ARB_copy_buffer"))
+        m_copy_buffer = (CopyBufferSubData)context->getProcAddress("glCopyBufferSubData");
+
     m_vertex_buffer.create();
     m_vertex_buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
     m_vertex_buffer.bind();
-    m_vertex_buffer.allocate(param->vertex->data(), param->vertex->size() * sizeof(float));
+    m_vertex_buffer.allocate(param->num_vertex * vertexSize());
     m_vertex_buffer.release();
+    m_vertex_allocator.reset(param->num_vertex);
 
     m_index_buffer.create();
     m_index_buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
     m_index_buffer.bind();
-    m_index_buffer.allocate(param->index->data(), param->index->size() * sizeof(ushort));
+    m_index_buffer.allocate(param->num_index * m_state.index_size);
     m_index_buffer.release();
+    m_index_allocator.reset(param->num_index);
 
-    QOpenGLContext *context = QOpenGLContext::currentContext();
     if (context->format().majorVersion() >= 3 ||
         context->hasExtension("GL_ARB_vertex_array_object") ||
         context->hasExtension("GL_OES_vertex_array_object")) {
@@ -78,15 +147,21 @@ GLRender::GLRender(RenderParam *param)
     }
 
     foreach (Material *material, *param->materials) {
-        if (material->init(param->lights, m_state.envmap ? true : false)) {
-            m_shaders.append(material->shader());
-            material->shader()->initialize();
-        }
+        initMaterial(material);
     }
+
+    Texture::printStatistics();
 }
 
 GLRender::~GLRender()
 {
+    for (QHash<Geometry *, GeometrySlot>::iterator it = m_slots.begin(); it != m_slots.end(); ++it) {
+        delete it.value().stream;
+        delete it.value().index_buffer;
+        if (it.value().buffers)
+            releaseBuffers(it.value());
+    }
+
     if (m_state.envmap)
         delete m_state.envmap;
 
@@ -96,10 +171,45 @@ GLRender::~GLRender()
     }
 }
 
+bool GLRender::initCompressedEnvTexture(EnvParam *env)
+{
+    for (int i = 0; i < 6; i++) {
+        KtxImage *ktx = env->ktx[i];
+        if (!ktx || !ktx->isCompressed() || !ktx->isSupported() ||
+            ktx->internalFormat() != env->ktx[0]->internalFormat() ||
+            ktx->levels() != env->ktx[0]->levels())
+            return false;
+    }
+
+    m_state.envmap = new QOpenGLTexture(QOpenGLTexture::TargetCubeMap);
+    m_state.envmap->create();
+    m_state.envmap->bind();
+
+    bool ok = true;
+    for (int i = 0; i < 6; i++)
+        ok &= env->ktx[i]->upload(this, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i);
+
+    m_state.envmap->release();
+    if (!ok) {
+        qWarning() << "compressed environment map upload fail, decode it";
+        delete m_state.envmap;
+        m_state.envmap = 0;
+        return false;
+    }
+
+    m_state.envmap->setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::ClampToEdge);
+    m_state.envmap->setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
+    m_state.envmap->setMinMagFilters(env->ktx[0]->hasMipChain() ?
+                                     QOpenGLTexture::LinearMipMapLinear :
+                                     QOpenGLTexture::Linear,
+                                     QOpenGLTexture::Linear);
+    return true;
+}
+
 bool GLRender::initEnvTexture(QOpenGLTexture::CubeMapFace face, QImage &image, QSize &size)
 {
     if (image.isNull()) {
-        static QByteArray data(size.width() * size.height() * 3, 0);
+        QByteArray data(size.width() * size.height() * 4, 0);
         m_state.envmap->setData(0, 0, face, QOpenGLTexture::RGBA,
                           QOpenGLTexture::UInt8, data.constData());
     }
@@ -116,12 +226,455 @@ bool GLRender::initEnvTexture(QOpenGLTexture::CubeMapFace face, QImage &image, Q
         return true;
 }
 
+void GLRender::initMaterial(Material *material)
+{
+    if (material->init(m_lights, m_state.envmap ? true : false, m_compact_vertex)) {
+        m_shaders.append(material->shader());
+        material->shader()->initialize();
+        m_draw_list.invalidate();
+        // state uniforms are only uploaded when dirty
+        m_state.setDirty();
+    }
+
+    if (!material->updateTextures())
+        m_pending_materials.append(material);
+}
+
+void GLRender::addMaterials(const QList<Material *> &materials)
+{
+    foreach (Material *material, materials) {
+        initMaterial(material);
+    }
+}
+
+void GLRender::updateTextures()
+{
+    for (int i = 0; i < m_pending_materials.size(); ) {
+        if (m_pending_materials[i]->updateTextures()) {
+            m_pending_materials.removeAt(i);
+            // decoded textures sort differently from the placeholder
+            m_draw_list.invalidate();
+        }
+        else
+            i++;
+    }
+}
+
+void GLRender::removeMaterials(const QList<Material *> &materials)
+{
+    foreach (Material *material, materials) {
+        m_pending_materials.removeOne(material);
+    }
+}
+
+GLenum GLRender::indexType(const Geometry *geometry) const
+{
+    // the scene's type is chosen for the models there at creation, a
+    // larger model added later doesn't need to be split when the context
+    // draws 32-bit indices
+    if (m_state.index_type == GL_UNSIGNED_SHORT && m_uint_index &&
+        geometry->vertexCount() > USHRT_MAX + 1)
+        return GL_UNSIGNED_INT;
+    return m_state.index_type;
+}
+
+void GLRender::packGeometry(const Geometry *geometry, QVector<Mesh> &meshes, GLenum index_type,
+                            QByteArray &vertex_data, QByteArray &index_data,
+                            QVector<uint> &copies)
+{
+    // vertices in the buffer layout
+    if (m_compact_vertex) {
+        vertex_data.resize(geometry->vertexCount() * sizeof(CompactVertex));
+        CompactVertex::pack(*geometry, (CompactVertex *)vertex_data.data());
+    }
+    else
+        vertex_data = QByteArray::fromRawData((const char *)geometry->vertices(),
+                                              geometry->vertexCount() * sizeof(Vertex));
+
+    // each mesh is drawn as index ranges relative to the vertices of
+    // its model, moved with the model's range
+    const QVector<uint> &index = geometry->indexArray();
+    if (index_type == GL_UNSIGNED_INT) {
+        index_data = QByteArray::fromRawData((const char *)index.constData(),
+                                             index.size() * sizeof(uint));
+        for (int i = 0; i < meshes.size(); i++)
+            setMeshRange(&meshes[i]);
+    }
+    else if (geometry->vertexCount() <= USHRT_MAX + 1) {
+        index_data.resize(index.size() * sizeof(ushort));
+        ushort *p = (ushort *)index_data.data();
+        for (int i = 0; i < index.size(); i++)
+            p[i] = index[i];
+        for (int i = 0; i < meshes.size(); i++)
+            setMeshRange(&meshes[i]);
+    }
+    else {
+        qDebug() << "model too large for 16-bit index, split meshes into ranges";
+        QVector<ushort> index16;
+        for (int i = 0; i < meshes.size(); i++)
+            splitMesh(&meshes[i], index, geometry->vertexCount(), copies, index16);
+        index_data = QByteArray((const char *)index16.constData(),
+                                index16.size() * sizeof(ushort));
+
+        if (!copies.isEmpty()) {
+            int size = vertexSize();
+            QByteArray source = vertex_data;
+            vertex_data.reserve(source.size() + copies.size() * size);
+            foreach (uint copy, copies) {
+                vertex_data.append(source.constData() + copy * size, size);
+            }
+        }
+    }
+}
+
+void GLRender::addGeometry(Geometry *geometry, QVector<Mesh> &meshes, bool dynamic,
+                           const QSharedPointer<SharedModel> &shared)
+{
+    if (shared && !dynamic) {
+        addSharedGeometry(geometry, meshes, shared);
+        return;
+    }
+
+    // only read through const, the arrays may be shared with other models
+    const Geometry *g = geometry;
+    GeometrySlot slot;
+    slot.stream = 0;
+    slot.buffers = 0;
+    slot.index_buffer = 0;
+    GLenum index_type = indexType(g);
+    QVector<uint> copies;
+    packGeometry(g, meshes, index_type, slot.vertex_data, slot.index_data, copies);
+
+    slot.vertex_count = dynamic ? 0 : slot.vertex_data.size() / vertexSize();
+    slot.vertex_offset = allocate(m_vertex_allocator, slot.vertex_count, true);
+
+    if (index_type != m_state.index_type) {
+        slot.index_buffer = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+        slot.index_buffer->create();
+        slot.index_buffer->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        slot.index_buffer->bind();
+        slot.index_buffer->allocate(slot.index_data.constData(), slot.index_data.size());
+        slot.index_buffer->release();
+        slot.index_data.clear();
+        slot.index_count = 0;
+        slot.index_offset = 0;
+    }
+    else {
+        slot.index_count = slot.index_data.size() / m_state.index_size;
+        slot.index_offset = allocate(m_index_allocator, slot.index_count, false);
+
+        m_index_buffer.bind();
+        m_index_buffer.write(slot.index_offset * m_state.index_size,
+                             slot.index_data.constData(), slot.index_data.size());
+        m_index_buffer.release();
+    }
+
+    if (dynamic) {
+        slot.stream = new StreamBuffer(slot.vertex_data, vertexSize());
+        slot.stream->setCopies(copies);
+        slot.vertex_data.clear();
+    }
+    else {
+        m_vertex_buffer.bind();
+        m_vertex_buffer.write(slot.vertex_offset * vertexSize(),
+                              slot.vertex_data.constData(), slot.vertex_data.size());
+        m_vertex_buffer.release();
+    }
+
+    for (int i = 0; i < meshes.size(); i++) {
+        Mesh *mesh = &meshes[i];
+        for (int j = 0; j < mesh->ranges.size(); j++) {
+            mesh->ranges[j].index_offset += slot.index_offset;
+            mesh->ranges[j].vertex_base += slot.vertex_offset;
+        }
+        if (slot.stream) {
+            mesh->vertex_buffer = slot.stream->bufferId();
+            mesh->vertex_offset = slot.stream->base();
+        }
+        mesh->index_buffer = slot.index_buffer ? slot.index_buffer->bufferId() : 0;
+        mesh->index_type = slot.index_buffer ? index_type : 0;
+        slot.meshes.append(mesh);
+    }
+
+    // the model's arrays are released after this, keep a copy only
+    // when the buffers can't be copied on the GPU
+    if (m_copy_buffer) {
+        slot.vertex_data.clear();
+        slot.index_data.clear();
+    }
+    else {
+        slot.vertex_data.detach();
+        slot.index_data.detach();
+    }
+
+    m_slots.insert(geometry, slot);
+    m_draw_list.invalidate();
+}
+
+void GLRender::addSharedGeometry(Geometry *geometry, QVector<Mesh> &meshes,
+                                 const QSharedPointer<SharedModel> &shared)
+{
+    // renders of a share group with the same layout draw from the same
+    // buffers, only the first one uploads them
+    GLenum index_type = indexType(geometry);
+    int index_size = index_type == GL_UNSIGNED_INT ? sizeof(uint) : sizeof(ushort);
+    int layout = vertexSize() | (index_size << 8);
+    SharedModel::Buffers *buffers = shared->acquireBuffers(layout);
+    if (!buffers) {
+        QByteArray vertex_data, index_data;
+        QVector<uint> copies;
+        packGeometry(geometry, meshes, index_type, vertex_data, index_data, copies);
+
+        buffers = new SharedModel::Buffers;
+        buffers->vertex.create();
+        buffers->vertex.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        buffers->vertex.bind();
+        buffers->vertex.allocate(vertex_data.constData(), vertex_data.size());
+        buffers->vertex.release();
+
+        buffers->index.create();
+        buffers->index.setUsagePattern(QOpenGLBuffer::StaticDraw);
+        buffers->index.bind();
+        buffers->index.allocate(index_data.constData(), index_data.size());
+        buffers->index.release();
+
+        for (int i = 0; i < meshes.size(); i++)
+            buffers->ranges.append(meshes[i].ranges);
+        buffers = shared->addBuffers(layout, buffers);
+    }
+
+    GeometrySlot slot;
+    slot.vertex_offset = 0;
+    slot.vertex_count = 0;
+    slot.index_offset = 0;
+    slot.index_count = 0;
+    slot.stream = 0;
+    slot.shared = shared;
+    slot.buffers = buffers;
+    slot.index_buffer = 0;
+
+    for (int i = 0; i < meshes.size() && i < buffers->ranges.size(); i++) {
+        Mesh *mesh = &meshes[i];
+        mesh->ranges = buffers->ranges[i];
+        mesh->vertex_buffer = buffers->vertex.bufferId();
+        mesh->vertex_offset = 0;
+        mesh->index_buffer = buffers->index.bufferId();
+        mesh->index_type = index_type;
+        slot.meshes.append(mesh);
+    }
+
+    m_slots.insert(geometry, slot);
+    m_draw_list.invalidate();
+}
+
+void GLRender::releaseBuffers(GeometrySlot &slot)
+{
+    // the names may be reused once the last render let them go
+    if (m_state.vertex_buffer == slot.buffers->vertex.bufferId())
+        m_state.vertex_buffer = 0;
+    if (m_state.index_buffer == slot.buffers->index.bufferId())
+        m_state.index_buffer = 0;
+    slot.shared->releaseBuffers(slot.buffers);
+    slot.buffers = 0;
+}
+
+void GLRender::removeGeometry(Geometry *geometry)
+{
+    if (!m_slots.contains(geometry))
+        return;
+
+    GeometrySlot slot = m_slots.take(geometry);
+    m_draw_list.invalidate();
+    if (slot.buffers) {
+        releaseBuffers(slot);
+        return;
+    }
+    if (slot.stream)
+        deleteStream(slot.stream);
+    if (slot.index_buffer) {
+        if (m_state.index_buffer == slot.index_buffer->bufferId())
+            m_state.index_buffer = 0;
+        delete slot.index_buffer;
+    }
+    m_vertex_allocator.free(slot.vertex_offset, slot.vertex_count);
+    m_index_allocator.free(slot.index_offset, slot.index_count);
+
+    // give memory back once the buffers are mostly empty
+    if (m_vertex_allocator.used() < m_vertex_allocator.capacity() / 4)
+        relocate(m_vertex_allocator.used() * 2, true);
+    if (m_index_allocator.used() < m_index_allocator.capacity() / 4)
+        relocate(m_index_allocator.used() * 2, false);
+}
+
+void GLRender::updateVertices(Geometry *geometry, int first, const Vertex *vertices, int count)
+{
+    QHash<Geometry *, GeometrySlot>::iterator it = m_slots.find(geometry);
+    if (it == m_slots.end() || !it.value().stream || it.value().meshes.isEmpty())
+        return;
+    GeometrySlot &slot = it.value();
+
+    if (m_compact_vertex) {
+        // quantized to the bounds at load, which the meshes are drawn with
+        QVector<CompactVertex> packed(count);
+        CompactVertex::pack(vertices, count, slot.meshes.first()->position_matrix, packed.data());
+        slot.stream->update(first, (const char *)packed.constData(), count);
+    }
+    else
+        slot.stream->update(first, (const char *)vertices, count);
+
+    foreach (Mesh *mesh, slot.meshes) {
+        mesh->vertex_offset = slot.stream->base();
+    }
+}
+
+void GLRender::deleteStream(StreamBuffer *stream)
+{
+    // the name may be reused, don't trust pointers still set up for it
+    if (m_state.vertex_buffer == stream->bufferId())
+        m_state.vertex_buffer = 0;
+    delete stream;
+}
+
+void GLRender::setMeshRange(Mesh *mesh)
+{
+    Mesh::Range range;
+    range.index_offset = mesh->index_offset;
+    range.index_count = mesh->index_count;
+    range.vertex_base = 0;
+    mesh->ranges.clear();
+    mesh->ranges.append(range);
+}
+
+int GLRender::vertexSize() const
+{
+    return m_compact_vertex ? sizeof(CompactVertex) : sizeof(Vertex);
+}
+
+int GLRender::allocate(BufferAllocator &allocator, int size, bool vertex)
+{
+    int offset = allocator.allocate(size);
+    if (offset >= 0)
+        return offset;
+
+    // no free range is large enough, pack everything into a larger buffer
+    relocate(qMax(allocator.used() + size, allocator.capacity() * 3 / 2), vertex);
+    return allocator.allocate(size);
+}
+
+void GLRender::relocate(int capacity, bool vertex)
+{
+    BufferAllocator &allocator = vertex ? m_vertex_allocator : m_index_allocator;
+    QOpenGLBuffer &old_buffer = vertex ? m_vertex_buffer : m_index_buffer;
+    int element_size = vertex ? vertexSize() : m_state.index_size;
+
+    qDebug() << (vertex ? "relocate vertex buffer:" : "relocate index buffer:")
+             << allocator.capacity() << "->" << capacity << "elements,"
+             << allocator.used() << "used";
+
+    // a new buffer, an element array one is only bound here outside the VAO
+    QOpenGLBuffer buffer(old_buffer.type());
+    buffer.create();
+    buffer.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    buffer.bind();
+    buffer.allocate(capacity * element_size);
+    buffer.release();
+
+    if (m_copy_buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, old_buffer.bufferId());
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer.bufferId());
+    }
+    else
+        buffer.bind();
+
+    allocator.reset(capacity);
+    for (QHash<Geometry *, GeometrySlot>::iterator it = m_slots.begin(); it != m_slots.end(); ++it) {
+        GeometrySlot &slot = it.value();
+        // drawn from buffers of their own
+        if (slot.buffers || (!vertex && slot.index_buffer))
+            continue;
+        int count = vertex ? slot.vertex_count : slot.index_count;
+        int old_offset = vertex ? slot.vertex_offset : slot.index_offset;
+        int offset = allocator.allocate(count);
+
+        if (m_copy_buffer)
+            m_copy_buffer(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                          old_offset * element_size, offset * element_size, count * element_size);
+        else {
+            const QByteArray &data = vertex ? slot.vertex_data : slot.index_data;
+            buffer.write(offset * element_size, data.constData(), data.size());
+        }
+
+        foreach (Mesh *mesh, slot.meshes) {
+            for (int i = 0; i < mesh->ranges.size(); i++) {
+                if (vertex)
+                    mesh->ranges[i].vertex_base += offset - old_offset;
+                else
+                    mesh->ranges[i].index_offset += offset - old_offset;
+            }
+        }
+
+        if (vertex)
+            slot.vertex_offset = offset;
+        else
+            slot.index_offset = offset;
+    }
+
+    if (m_copy_buffer) {
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    }
+    else
+        buffer.release();
+
+    old_buffer.destroy();
+    old_buffer = buffer;
+
+    // point the VAO at the new buffer
+    if (m_use_vao) {
+        m_vao.bind();
+        uploadVertexData();
+        m_vao.release();
+    }
+}
+
+void GLRender::initLights()
+{
+    m_state.lights.resize(m_lights->size());
+    for (int i = 0; i < m_lights->size(); i++) {
+        m_state.lights[i].light = m_lights->at(i);
+        m_state.lights[i].node = 0;
+        m_state.lights[i].node_revision = -1;
+    }
+}
+
+void GLRender::updateLights()
+{
+    initLights();
+
+    foreach (GLShader *shader, m_shaders) {
+        shader->updateLights();
+    }
+
+    // uniforms are lost when the shaders are linked again
+    m_draw_list.invalidate();
+    m_state.setDirty();
+}
+
 void GLRender::updateLightFinalPos()
 {
     for (int i = 0; i < m_state.lights.size(); i++) {
-        Light *light = m_state.lights[i].light;
+        RenderState::RSLight &rs = m_state.lights[i];
+        Light *light = rs.light;
+        // neither the light nor its node moved
+        if (rs.node == light->node && rs.node_revision == light->node->revision() &&
+            rs.pos == light->pos)
+            continue;
+        rs.node = light->node;
+        rs.node_revision = light->node->revision();
+        rs.pos = light->pos;
+
         QVector3D pos;
-        QMatrix4x4 &mat = light->node->modelviewMatrix();
+        const QMatrix4x4 &mat = light->node->modelviewMatrix();
         switch (light->type) {
         case Light::POINT:
             pos = mat * light->pos;
@@ -221,6 +774,9 @@ void GLRender::restoreOpenGLState()
 
 void GLRender::render()
 {
+    if (!m_pending_materials.isEmpty())
+        updateTextures();
+
     if (!m_state.visible)
         return;
 
@@ -230,9 +786,21 @@ void GLRender::render()
     glViewport(m_viewport.x(), m_viewport.y(), m_viewport.width(), m_viewport.height());
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    if (m_draw_list.isDirty()) {
+        m_draw_list.build(m_root, m_shaders);
+        foreach (GLShader *shader, m_shaders) {
+            shader->forgetLastNode();
+        }
+    }
+    m_draw_list.sort();
+    m_state.statistics = RenderState::Statistics();
+
     if (m_use_vao) {
         m_vao.bind();
         //m_index_buffer.bind();
+
+        // attribute pointers are moved for each index range
+        m_vertex_buffer.bind();
     }
     else
         uploadVertexData();
@@ -240,6 +808,21 @@ void GLRender::render()
     doRender(false);    
     doRender(true);
 
+    // the dirty flags are reset for all shaders, those without draws
+    // in this frame would miss the changes
+    if (m_state.isDirty()) {
+        foreach (GLShader *shader, m_shaders) {
+            bool drawn = false;
+            foreach (const DrawList::Batch &batch, m_draw_list.batches()) {
+                if (batch.shader == shader) {
+                    drawn = true;
+                    break;
+                }
+            }
+            if (!drawn)
+                shader->updateState(&m_state);
+        }
+    }
     m_state.resetDirty();
 
     glDisableVertexAttribArray(0);
@@ -249,6 +832,7 @@ void GLRender::render()
     if (m_use_vao) {
         //m_index_buffer.release();
         m_vao.release();
+        m_vertex_buffer.release();
     }
     else {
         m_index_buffer.release();
@@ -261,24 +845,149 @@ void GLRender::render()
     restoreOpenGLState();
 }
 
+void GLRender::initVertexLayout()
+{
+    RenderState::VertexAttribute *attr = m_state.attributes;
+
+    attr[0].size = 3;
+    attr[0].type = GL_FLOAT;
+    attr[0].normalized = GL_FALSE;
+    attr[0].stride = sizeof(Vertex);
+    attr[0].offset = offsetof(Vertex, position);
+
+    attr[1].size = 3;
+    attr[1].type = GL_FLOAT;
+    attr[1].normalized = GL_FALSE;
+    attr[1].stride = sizeof(Vertex);
+    attr[1].offset = offsetof(Vertex, normal);
+
+    attr[2].size = 2;
+    attr[2].type = GL_FLOAT;
+    attr[2].normalized = GL_FALSE;
+    attr[2].stride = sizeof(Vertex);
+    attr[2].offset = offsetof(Vertex, uv);
+
+    m_state.vertex_base = 0;
+}
+
+bool GLRender::initCompactVertexLayout()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+
+    GLenum half_float;
+    if (context->format().majorVersion() >= 3 ||
+        (!context->isOpenGLES() && context->hasExtension("GL_ARB_half_float_vertex")))
+        half_float = GL_HALF_FLOAT;
+    else if (context->isOpenGLES() && context->hasExtension("GL_OES_vertex_half_float"))
+        half_float = GL_HALF_FLOAT_OES;
+    else
+        return false;
+
+    RenderState::VertexAttribute *attr = m_state.attributes;
+
+    attr[0].size = 3;
+    attr[0].type = GL_SHORT;
+    attr[0].normalized = GL_TRUE;
+    attr[0].stride = sizeof(CompactVertex);
+    attr[0].offset = offsetof(CompactVertex, position);
+
+    attr[1].size = 2;
+    attr[1].type = GL_SHORT;
+    attr[1].normalized = GL_TRUE;
+    attr[1].stride = sizeof(CompactVertex);
+    attr[1].offset = offsetof(CompactVertex, normal);
+
+    attr[2].size = 2;
+    attr[2].type = half_float;
+    attr[2].normalized = GL_FALSE;
+    attr[2].stride = sizeof(CompactVertex);
+    attr[2].offset = offsetof(CompactVertex, uv);
+
+    m_state.vertex_base = 0;
+    return true;
+}
+
 void GLRender::uploadVertexData()
 {
     m_vertex_buffer.bind();
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_TRUE, 6 * sizeof(float), 0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_TRUE, 6 * sizeof(float),
-                          (void *)(3 * sizeof(float)));
-    if (m_has_texture_uv)
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_TRUE, 2 * sizeof(float),
-                              (void *)(m_num_vertex * 6 * sizeof(float)));
+    for (int i = 0; i < 3; i++) {
+        RenderState::VertexAttribute &a = m_state.attributes[i];
+        if (a.size)
+            glVertexAttribPointer(i, a.size, a.type, a.normalized, a.stride,
+                                  (void *)(qintptr)a.offset);
+    }
+    m_state.scene_vertex_buffer = m_vertex_buffer.bufferId();
+    m_state.vertex_buffer = m_state.scene_vertex_buffer;
+    m_state.vertex_base = 0;
     m_index_buffer.bind();
+    m_state.scene_index_buffer = m_index_buffer.bufferId();
+    m_state.index_buffer = m_state.scene_index_buffer;
+}
+
+void GLRender::splitMesh(Mesh *mesh, const QVector<uint> &index, int vertex_count,
+                         QVector<uint> &copies, QVector<ushort> &index16)
+{
+    // a triangle spanning more vertices than 16 bits reach is drawn
+    // from copies of its vertices appended to the model's
+    QVector<uint> triangles;
+    QVector<uint> wide;
+    triangles.reserve(mesh->index_count);
+    int end = mesh->index_offset + mesh->index_count;
+    for (int i = mesh->index_offset; i < end; i += 3) {
+        uint tlow = qMin(index[i], qMin(index[i + 1], index[i + 2]));
+        uint thigh = qMax(index[i], qMax(index[i + 1], index[i + 2]));
+        if (thigh - tlow > USHRT_MAX) {
+            for (int j = 0; j < 3; j++) {
+                wide.append(vertex_count + copies.size());
+                copies.append(index[i + j]);
+            }
+        }
+        else {
+            triangles.append(index[i]);
+            triangles.append(index[i + 1]);
+            triangles.append(index[i + 2]);
+        }
+    }
+    triangles += wide;
+
+    mesh->ranges.clear();
+    uint low = UINT_MAX, high = 0;
+    int first = 0;
+    for (int i = 0; i <= triangles.size(); i += 3) {
+        uint tlow = 0, thigh = 0;
+        if (i < triangles.size()) {
+            tlow = qMin(triangles[i], qMin(triangles[i + 1], triangles[i + 2]));
+            thigh = qMax(triangles[i], qMax(triangles[i + 1], triangles[i + 2]));
+        }
+
+        // close current range when the triangle doesn't fit in it
+        if (i > first &&
+            (i == triangles.size() || qMax(high, thigh) - qMin(low, tlow) > USHRT_MAX)) {
+            Mesh::Range range;
+            range.index_offset = index16.size();
+            range.index_count = i - first;
+            range.vertex_base = low;
+            for (int j = first; j < i; j++)
+                index16.append(triangles[j] - low);
+            mesh->ranges.append(range);
+
+            first = i;
+            low = UINT_MAX;
+            high = 0;
+        }
+
+        low = qMin(low, tlow);
+        high = qMax(high, thigh);
+    }
 }
 
 void GLRender::doRender(bool blendMode)
 {
     bool init_blend = false;
-    foreach (GLShader *shader, m_shaders) {
-        if (!shader->setBlend(blendMode))
+    foreach (const DrawList::Batch &batch, m_draw_list.batches()) {
+        if (batch.blend != blendMode)
             continue;
+        GLShader *shader = batch.shader;
 
         if (!init_blend) {
             if (blendMode) {
@@ -296,7 +1005,7 @@ void GLRender::doRender(bool blendMode)
             else
                 glDisableVertexAttribArray(i);
         }
-        shader->render(m_root, &m_state);
+        shader->render(m_draw_list.draws().constData() + batch.first, batch.count, &m_state);
     }
 }
 
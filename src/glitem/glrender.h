@@ -2,26 +2,35 @@
 #define GLRENDER_H
 
 #include "renderstate.h"
+#include "bufferallocator.h"
+#include "streambuffer.h"
+#include "drawlist.h"
+#include "sharedmodel.h"
 #include <QOpenGLFunctions>
 #include <QOpenGLBuffer>
 #include <QOpenGLTexture>
 #include <QOpenGLVertexArrayObject>
 #include <QObject>
+#include <QHash>
 
 class GLShader;
 class GLTransformNode;
 class Material;
 class EnvParam;
+class Mesh;
+class Geometry;
+struct Vertex;
 
 struct RenderParam {
     GLTransformNode *root;
-    QVector<float> *vertex;
-    QVector<ushort> *index;
     QList<Material *> *materials;
     QList<Light *> *lights;
     EnvParam *env;
-    bool has_texture_uv;
+    // initial buffer sizes, models are uploaded with addGeometry()
     int num_vertex;
+    int num_index;
+    int max_model_vertex;
+    bool compact_vertex;
 };
 
 class GLRender : public QObject, protected QOpenGLFunctions
@@ -34,8 +43,27 @@ public:
     RenderState *state() { return &m_state; }
     GLTransformNode *root() { return m_root; }
     void updateLightFinalPos();
+    void updateLights();
     void setViewport(const QRect &viewport);
 
+    // upload a model into free ranges of the scene buffers, its meshes
+    // are drawn from there until it is removed, vertices of dynamic
+    // ones go to a stream buffer of their own and shared models use
+    // the buffers of their share group
+    void addGeometry(Geometry *geometry, QVector<Mesh> &meshes, bool dynamic = false,
+                     const QSharedPointer<SharedModel> &shared = QSharedPointer<SharedModel>());
+    void removeGeometry(Geometry *geometry);
+    // replace vertices [first, first + count) of a dynamic model
+    void updateVertices(Geometry *geometry, int first, const Vertex *vertices, int count);
+
+    void addMaterials(const QList<Material *> &materials);
+    void removeMaterials(const QList<Material *> &materials);
+    bool hasPendingTextures() const { return !m_pending_materials.isEmpty(); }
+
+    // node visibility or materials changed, models added or removed
+    // through addGeometry() and removeGeometry() invalidate it themselves
+    void invalidateDrawList() { m_draw_list.invalidate(); }
+
 public slots:
     void render();
 
@@ -44,9 +72,12 @@ private:
     RenderState m_state;
     QRect m_viewport;
     QList<GLShader *> m_shaders;
-    bool m_has_texture_uv;
-    int m_num_vertex;
+    DrawList m_draw_list;
+    bool m_compact_vertex;
     QList<Material *> *m_materials;
+    QList<Light *> *m_lights;
+    // materials still sampling placeholder textures
+    QList<Material *> m_pending_materials;
 
     struct OpenGLState {
         bool depth_mask;
@@ -60,6 +91,33 @@ private:
 
     QOpenGLBuffer m_vertex_buffer;
     QOpenGLBuffer m_index_buffer;
+    BufferAllocator m_vertex_allocator;
+    BufferAllocator m_index_allocator;
+
+    // where a model is in the scene buffers, in elements
+    struct GeometrySlot {
+        int vertex_offset;
+        int vertex_count;
+        int index_offset;
+        int index_count;
+        QList<Mesh *> meshes;
+        // vertices of a dynamic model, not in the scene buffer
+        StreamBuffer *stream;
+        // buffers of a shared model, not in the scene buffers either
+        QSharedPointer<SharedModel> shared;
+        SharedModel::Buffers *buffers;
+        // 32-bit indices of a model added later to a 16-bit scene
+        QOpenGLBuffer *index_buffer;
+        // uploaded data, only kept without GPU buffer copies
+        QByteArray vertex_data;
+        QByteArray index_data;
+    };
+    QHash<Geometry *, GeometrySlot> m_slots;
+
+    typedef void (QOPENGLF_APIENTRYP CopyBufferSubData)(GLenum, GLenum, GLintptr, GLintptr, GLsizeiptr);
+    CopyBufferSubData m_copy_buffer;
+    // 32-bit indices can be drawn
+    bool m_uint_index;
 
     bool m_use_vao;
     QOpenGLVertexArrayObject m_vao;
@@ -68,11 +126,32 @@ private:
     void switchOpenGlState();
     void restoreOpenGLState();
 
+    bool initCompressedEnvTexture(EnvParam *env);
     bool initEnvTexture(QOpenGLTexture::CubeMapFace face, QImage &image, QSize &size);
 
     void doRender(bool blendMode);
 
+    void initLights();
+    void initMaterial(Material *material);
+    void updateTextures();
+
+    void initVertexLayout();
+    bool initCompactVertexLayout();
     void uploadVertexData();
+    int vertexSize() const;
+    int allocate(BufferAllocator &allocator, int size, bool vertex);
+    void relocate(int capacity, bool vertex);
+    void deleteStream(StreamBuffer *stream);
+    GLenum indexType(const Geometry *geometry) const;
+    void packGeometry(const Geometry *geometry, QVector<Mesh> &meshes, GLenum index_type,
+                      QByteArray &vertex_data, QByteArray &index_data,
+                      QVector<uint> &copies);
+    void addSharedGeometry(Geometry *geometry, QVector<Mesh> &meshes,
+                           const QSharedPointer<SharedModel> &shared);
+    void releaseBuffers(GeometrySlot &slot);
+    void setMeshRange(Mesh *mesh);
+    void splitMesh(Mesh *mesh, const QVector<uint> &index, int vertex_count,
+                   QVector<uint> &copies, QVector<ushort> &index16);
 
     void printOpenGLInfo();
 };
@@ -12,14 +12,16 @@
     "precision mediump float;\n" \
     "#endif\n"
 
-GLShader::GLShader()
-    : m_has_transparency(false), m_has_opaque(false),
-      m_blend_mode(false), m_last_node(0)
+GLShader::GLShader(bool compact_vertex)
+    : m_compact_vertex(compact_vertex),
+      m_last_node(0), m_state(0)
 {
 }
 
 void GLShader::initialize()
 {
+    initializeOpenGLFunctions();
+
     m_program.addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShader());
     m_program.addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShader());
 
@@ -40,16 +42,6 @@ void GLShader::initialize()
     m_program.release();
 }
 
-bool GLShader::setBlend(bool mode)
-{
-    if ((mode && !m_has_transparency) ||
-        (!mode && !m_has_opaque))
-        return false;
-
-    m_blend_mode = mode;
-    return true;
-}
-
 void GLShader::bind()
 {
     m_program.bind();
@@ -80,47 +72,109 @@ void GLShader::updatePerRenderNode(GLRenderNode *n, GLRenderNode *o)
 
     float opacity = m_global_opacity * pn->opacity();
     if (!po || opacity != m_opacity) {
-        program()->setUniformValue(m_id_opacity, opacity);
+        setUniform(m_id_opacity, opacity);
         m_opacity = opacity;
     }
 }
 
-void GLShader::render(GLTransformNode *root, RenderState *state)
+void GLShader::render(const DrawList::Draw *draws, int count, RenderState *state)
 {
+    m_state = state;
     bind();
     updateRenderState(state);
-    renderNode(root);
+
+    GLTransformNode *tnode = 0;
+    const QMatrix4x4 *position_matrix = 0;
+    for (int i = 0; i < count; i++) {
+        const DrawList::Draw &draw = draws[i];
+        if (draw.tnode != tnode) {
+            tnode = draw.tnode;
+            position_matrix = 0;
+            updatePerTansformNode(tnode);
+        }
+
+        // quantized positions are relative to their model's bounds
+        if (m_compact_vertex &&
+            (!position_matrix || *position_matrix != draw.mesh->position_matrix)) {
+            position_matrix = &draw.mesh->position_matrix;
+            updateModelviewMatrix(tnode->modelviewMatrix() * *position_matrix);
+        }
+
+        updatePerRenderNode(draw.rnode);
+        drawMesh(draw.mesh);
+    }
+
     release();
 }
 
-void GLShader::renderNode(GLTransformNode *node)
+void GLShader::updateState(RenderState *state)
 {
-    if (!node->visible())
+    m_state = state;
+    m_program.bind();
+    updateRenderState(state);
+    m_program.release();
+}
+
+void GLShader::bindTexture(QOpenGLTexture *texture, int unit)
+{
+    texture->bind(unit);
+    m_state->statistics.texture_binds++;
+}
+
+void GLShader::drawMesh(Mesh *mesh)
+{
+    setIndexBuffer(mesh->index_buffer);
+    GLenum index_type = mesh->index_type ? mesh->index_type : m_state->index_type;
+    int index_size = index_type == GL_UNSIGNED_INT ? sizeof(uint) : sizeof(ushort);
+
+    if (mesh->ranges.isEmpty()) {
+        m_state->statistics.draw_calls++;
+        glDrawElements(GL_TRIANGLES, mesh->index_count, index_type,
+                       (GLvoid *)(qintptr)(mesh->index_offset * index_size));
         return;
+    }
 
-    bool updated = false;
-    foreach (GLRenderNode *rnode, node->renderChildren()) {
-        if (rnode->material()->shader() == this &&
-            rnode->material()->transparent() == m_blend_mode &&
-            rnode->visible()) {
-            if (!updated) {
-                updatePerTansformNode(node);
-                updated = true;
-            }
-
-            updatePerRenderNode(rnode);
-            glDrawElements(GL_TRIANGLES, rnode->mesh()->index_count, GL_UNSIGNED_SHORT,
-                           (GLvoid *)rnode->mesh()->index_offset);
-        }
+    foreach (const Mesh::Range &range, mesh->ranges) {
+        setVertexBase(mesh->vertex_buffer, mesh->vertex_offset + range.vertex_base);
+        m_state->statistics.draw_calls++;
+        glDrawElements(GL_TRIANGLES, range.index_count, index_type,
+                       (GLvoid *)(qintptr)(range.index_offset * index_size));
     }
+}
+
+void GLShader::setVertexBase(GLuint buffer, int base)
+{
+    if (!buffer)
+        buffer = m_state->scene_vertex_buffer;
+    if (m_state->vertex_buffer == buffer && m_state->vertex_base == base)
+        return;
 
-    foreach (GLTransformNode *tnode, node->transformChildren()) {
-        renderNode(tnode);
+    // pointers take the buffer bound when they are set
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+    for (int i = 0; i < 3; i++) {
+        RenderState::VertexAttribute &attr = m_state->attributes[i];
+        if (attr.size)
+            glVertexAttribPointer(i, attr.size, attr.type, attr.normalized, attr.stride,
+                                  (void *)(qintptr)(attr.offset + base * attr.stride));
     }
+    m_state->vertex_buffer = buffer;
+    m_state->vertex_base = base;
 }
 
-GLBasicShader::GLBasicShader(bool has_texture)
-    : GLShader(), m_has_texture(has_texture)
+void GLShader::setIndexBuffer(GLuint buffer)
+{
+    if (!buffer)
+        buffer = m_state->scene_index_buffer;
+    if (m_state->index_buffer == buffer)
+        return;
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    m_state->index_buffer = buffer;
+}
+
+GLBasicShader::GLBasicShader(bool has_texture, bool compact_vertex)
+    : GLShader(compact_vertex), m_has_texture(has_texture)
 {
     m_attribute_activities[0] = true;
     m_attribute_activities[1] = false;
@@ -155,11 +209,12 @@ QString GLBasicShader::fragmentShader()
     "uniform lowp float opacity;\n"
     "#ifdef USE_MAP\n"
     "uniform sampler2D texture_map;\n"
+    "uniform mediump float lod_bias;\n"
     "varying vec2 texcoord;\n"
     "#endif\n"
     "void main() {\n"
     "#ifdef USE_MAP\n"
-    "    gl_FragColor = texture2D(texture_map, texcoord) * opacity;\n"
+    "    gl_FragColor = texture2D(texture_map, texcoord, lod_bias) * opacity;\n"
     "#else\n"
     "    gl_FragColor = vec4(1.0, 1.0, 1.0, 1.0) * opacity;\n"
     "#endif\n"
@@ -189,6 +244,11 @@ void GLBasicShader::resolveUniforms() {
             qWarning("GLBasicShader does not implement 'uniform sampler2D texture_map;' in its shader");
         }
         program()->setUniformValue(m_id_texture_map, 0);
+
+        m_id_lod_bias = program()->uniformLocation("lod_bias");
+        if (m_id_lod_bias < 0) {
+            qWarning("GLBasicShader does not implement 'uniform mediump float lod_bias;' in its shader");
+        }
     }
 }
 
@@ -200,13 +260,19 @@ void GLBasicShader::updatePerRenderNode(GLRenderNode *n, GLRenderNode *o)
     BasicMaterial *po = o ? static_cast<BasicMaterial *>(o->material()) : 0;
 
     if (m_has_texture && (!po || po->texture() != pn->texture()))
-        pn->texture()->bind(0);
+        bindTexture(pn->texture(), 0);
 }
 
 void GLBasicShader::updatePerTansformNode(GLTransformNode *t)
 {
-    QMatrix4x4 &modelview = t->modelviewMatrix();
-    program()->setUniformValue(m_id_combined_matrix, m_projection_matrix * modelview);
+    if (!m_compact_vertex)
+        setUniform(m_id_combined_matrix,
+                   t->combinedMatrix(m_state->projection_matrix, m_state->projection_serial));
+}
+
+void GLBasicShader::updateModelviewMatrix(const QMatrix4x4 &modelview)
+{
+    setUniform(m_id_combined_matrix, m_projection_matrix * modelview);
 }
 
 void GLBasicShader::updateRenderState(RenderState *s)
@@ -215,6 +281,8 @@ void GLBasicShader::updateRenderState(RenderState *s)
 
     if (s->projection_matrix_dirty)
         m_projection_matrix = s->projection_matrix;
+    if (m_has_texture && s->lod_bias_dirty)
+        setUniform(m_id_lod_bias, s->lod_bias);
 }
 
 void GLBasicShader::bind()
@@ -223,7 +291,7 @@ void GLBasicShader::bind()
             m_last_node ? static_cast<BasicMaterial *>(m_last_node->material()) : 0;
 
     if (m_has_texture && last)
-        last->texture()->bind(0);
+        bindTexture(last->texture(), 0);
 
     GLShader::bind();
 }
@@ -242,8 +310,9 @@ void GLBasicShader::release()
 const int GLPhongShader::m_max_lights;
 
 GLPhongShader::GLPhongShader(const QList<Light *> *lights, bool has_diffuse_texture,
-                             bool has_specular_texture, bool has_env_map)
-    : GLShader(), m_lights(lights),
+                             bool has_specular_texture, bool has_env_map,
+                             bool compact_vertex)
+    : GLShader(compact_vertex), m_lights(lights),
       m_num_lights(qMin(m_max_lights, m_lights->size())),
       m_has_diffuse_texture(has_diffuse_texture),
       m_has_specular_texture(has_specular_texture),
@@ -255,16 +324,36 @@ GLPhongShader::GLPhongShader(const QList<Light *> *lights, bool has_diffuse_text
     m_attribute_activities[2] = m_has_diffuse_texture || m_has_diffuse_texture;
 }
 
+void GLPhongShader::updateLights()
+{
+    // lights are generated into the shader source
+    m_num_lights = qMin(m_max_lights, m_lights->size());
+    program()->removeAllShaders();
+    initialize();
+}
+
 QString GLPhongShader::vertexShader()
 {
     return
     QString(m_has_diffuse_texture || m_has_specular_texture ?
-    "#define TEXTURED_VERTEX\n" : "") +
+    "#define TEXTURED_VERTEX\n" : "")
+    + QString(m_compact_vertex ?
+    "#define COMPACT_VERTEX\n" : "") +
     "uniform highp mat4 modelview_matrix;\n"
     "uniform highp mat4 projection_matrix;\n"
     "uniform highp mat3 normal_matrix;\n"
     "attribute vec3 positionIn;\n"
+    "#ifdef COMPACT_VERTEX\n"
+    "attribute vec2 normalIn;\n"
+    "vec3 decodeNormal(vec2 e) {\n"
+    "    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));\n"
+    "    if (n.z < 0.0)\n"
+    "        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+    "    return normalize(n);\n"
+    "}\n"
+    "#else\n"
     "attribute vec3 normalIn;\n"
+    "#endif\n"
     "varying vec3 normal;\n"
     "varying vec3 eyePosition;\n"
     "#ifdef TEXTURED_VERTEX\n"
@@ -274,7 +363,11 @@ QString GLPhongShader::vertexShader()
     "void main() {\n"
     "    vec4 eyeTemp = modelview_matrix * vec4(positionIn, 1);\n"
     "    eyePosition = eyeTemp.xyz;\n"
+    "#ifdef COMPACT_VERTEX\n"
+    "    normal = normal_matrix * decodeNormal(normalIn);\n"
+    "#else\n"
     "    normal = normal_matrix * normalIn;\n"
+    "#endif\n"
     "#ifdef TEXTURED_VERTEX\n"
     "    texcoord = texcoordIn;\n"
     "#endif\n"
@@ -342,6 +435,9 @@ QString GLPhongShader::fragmentShader()
     "uniform samplerCube env_map;\n"
     "uniform lowp float env_alpha;\n"
     "#endif\n"
+    "#if defined(USE_MAP) || defined(USE_SPECULAR_MAP) || defined(USE_ENV_MAP)\n"
+    "uniform mediump float lod_bias;\n"
+    "#endif\n"
     "varying vec3 normal;\n"
     "varying vec3 eyePosition;\n"
     "#if defined(USE_MAP) || defined(USE_SPECULAR_MAP)\n"
@@ -356,15 +452,15 @@ QString GLPhongShader::fragmentShader()
     "    vec3 specular = vec3(0.0);\n"
     + lights_calc +
     "#ifdef USE_MAP\n"
-    "    diffuse *= texture2D(diffuse_texture, texcoord).rgb;\n"
+    "    diffuse *= texture2D(diffuse_texture, texcoord, lod_bias).rgb;\n"
     "#endif\n"
     "#ifdef USE_SPECULAR_MAP\n"
-    "    specular *= texture2D(specular_texture, texcoord).rgb;\n"
+    "    specular *= texture2D(specular_texture, texcoord, lod_bias).rgb;\n"
     "#endif\n"
     "    vec3 color = Ka * light_amb + Kd * diffuse + Ks * specular;\n"
     "#ifdef USE_ENV_MAP\n"
     "    vec3 ER = reflect(-V, N);\n"
-    "    color = mix(color, textureCube(env_map, ER).rgb, env_alpha);\n"
+    "    color = mix(color, textureCube(env_map, ER, lod_bias).rgb, env_alpha);\n"
     "#endif\n"
     "    gl_FragColor = vec4(color, 1.0) * opacity;\n"
     "}\n";
@@ -469,6 +565,13 @@ void GLPhongShader::resolveUniforms() {
         }
         program()->setUniformValue(m_id_specular_texture, texture_slot);
     }
+
+    if (m_has_env_map || m_has_diffuse_texture || m_has_specular_texture) {
+        m_id_lod_bias = program()->uniformLocation("lod_bias");
+        if (m_id_lod_bias < 0) {
+            qWarning("GLPhongShader does not implement 'uniform mediump float lod_bias;' in its shader");
+        }
+    }
 }
 
 void GLPhongShader::updatePerRenderNode(GLRenderNode *n, GLRenderNode *o)
@@ -479,29 +582,36 @@ void GLPhongShader::updatePerRenderNode(GLRenderNode *n, GLRenderNode *o)
     PhongMaterial *po = o ? static_cast<PhongMaterial *>(o->material()) : 0;
 
     if (!po || po->ka() != pn->ka())
-        program()->setUniformValue(m_id_ka, pn->ka());
+        setUniform(m_id_ka, pn->ka());
     if (!po || po->kd() != pn->kd())
-        program()->setUniformValue(m_id_kd, pn->kd());
+        setUniform(m_id_kd, pn->kd());
     if (!po || po->ks() != pn->ks())
-        program()->setUniformValue(m_id_ks, pn->ks());
+        setUniform(m_id_ks, pn->ks());
     if (!po || po->alpha() != pn->alpha())
-        program()->setUniformValue(m_id_alpha, pn->alpha());
+        setUniform(m_id_alpha, pn->alpha());
 
     if (m_has_env_map && (!po || po->env_alpha() != pn->env_alpha()))
-        program()->setUniformValue(m_id_env_alpha, pn->env_alpha());
+        setUniform(m_id_env_alpha, pn->env_alpha());
 
     int texture_slot = m_has_env_map ? 1 : 0;
     if (m_has_diffuse_texture && (!po || po->diffuseTexture() != pn->diffuseTexture()))
-        pn->diffuseTexture()->bind(texture_slot++);
+        bindTexture(pn->diffuseTexture(), texture_slot++);
     if (m_has_specular_texture && (!po || po->specularTexture() != pn->specularTexture()))
-        pn->specularTexture()->bind(texture_slot);
+        bindTexture(pn->specularTexture(), texture_slot);
 }
 
 void GLPhongShader::updatePerTansformNode(GLTransformNode *t)
 {
-    QMatrix4x4 &modelview = t->modelviewMatrix();
-    program()->setUniformValue(m_id_modelview_matrix, modelview);
-    program()->setUniformValue(m_id_normal_matrix, modelview.normalMatrix());
+    const QMatrix4x4 &modelview = t->modelviewMatrix();
+    // with compact vertices the dequantize scale must stay out of normals
+    if (!m_compact_vertex)
+        updateModelviewMatrix(modelview);
+    setUniform(m_id_normal_matrix, t->normalMatrix());
+}
+
+void GLPhongShader::updateModelviewMatrix(const QMatrix4x4 &modelview)
+{
+    setUniform(m_id_modelview_matrix, modelview);
 }
 
 void GLPhongShader::updateRenderState(RenderState *s)
@@ -509,21 +619,24 @@ void GLPhongShader::updateRenderState(RenderState *s)
     GLShader::updateRenderState(s);
 
     if (s->projection_matrix_dirty)
-        program()->setUniformValue(m_id_projection_matrix, s->projection_matrix);
+        setUniform(m_id_projection_matrix, s->projection_matrix);
     if (s->light_amb_dirty)
-        program()->setUniformValue(m_id_light_amb, s->light_amb);
+        setUniform(m_id_light_amb, s->light_amb);
+    if ((m_has_env_map || m_has_diffuse_texture || m_has_specular_texture) &&
+        s->lod_bias_dirty)
+        setUniform(m_id_lod_bias, s->lod_bias);
 
     if (m_has_env_map && s->envmap)
-        s->envmap->bind(0);
+        bindTexture(s->envmap, 0);
 
     Q_ASSERT(m_num_lights <= s->lights.size());
     for (int i = 0; i < m_num_lights; i++) {
         if (s->lights[i].final_pos_dirty)
-            program()->setUniformValue(m_id_light_pos[i], s->lights[i].final_pos);
+            setUniform(m_id_light_pos[i], s->lights[i].final_pos);
         if (s->lights[i].light->dif_dirty)
-            program()->setUniformValue(m_id_light_dif[i], s->lights[i].light->dif);
+            setUniform(m_id_light_dif[i], s->lights[i].light->dif);
         if (s->lights[i].light->spec_dirty)
-            program()->setUniformValue(m_id_light_spec[i], s->lights[i].light->spec);
+            setUniform(m_id_light_spec[i], s->lights[i].light->spec);
     }
 }
 
@@ -534,9 +647,9 @@ void GLPhongShader::bind()
 
     int texture_slot = m_has_env_map ? 1 : 0;
     if (m_has_diffuse_texture && last)
-        last->diffuseTexture()->bind(texture_slot++);
+        bindTexture(last->diffuseTexture(), texture_slot++);
     if (m_has_specular_texture && last)
-        last->specularTexture()->bind(texture_slot);
+        bindTexture(last->specularTexture(), texture_slot);
 
     GLShader::bind();
 }
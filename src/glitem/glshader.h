@@ -3,34 +3,41 @@
 
 #include <QList>
 #include <QOpenGLShaderProgram>
+#include <QOpenGLFunctions>
+#include "drawlist.h"
+#include "renderstate.h"
 
+class QOpenGLTexture;
 class Light;
-class RenderState;
+class Mesh;
 class GLRenderNode;
 class GLTransformNode;
 
-class GLShader
+class GLShader : protected QOpenGLFunctions
 {
 public:
-    GLShader();
+    GLShader(bool compact_vertex);
     QOpenGLShaderProgram *program() { return &m_program; }
 
     void initialize();
-    void render(GLTransformNode *root, RenderState *state);
+    void render(const DrawList::Draw *draws, int count, RenderState *state);
+    // takes the state changes of a frame the shader draws nothing in
+    void updateState(RenderState *state);
 
     bool *attributeActivities() { return m_attribute_activities; }
 
-    void hasTransparency() { m_has_transparency = true; }
-    void hasOpaque() { m_has_opaque = true; }
-    bool setBlend(bool mode);
+    // the last drawn node may be gone once the scene changed
+    void forgetLastNode() { m_last_node = 0; }
+
+    // called when lights are added to the scene
+    virtual void updateLights() {}
 
 protected:
-    bool m_has_transparency;
-    bool m_has_opaque;
-    bool m_blend_mode;
+    bool m_compact_vertex;
 
     float m_global_opacity;
     GLRenderNode *m_last_node;
+    RenderState *m_state;
     bool m_attribute_activities[3];
 
     virtual void resolveUniforms();
@@ -39,8 +46,17 @@ protected:
 
     virtual void updatePerRenderNode(GLRenderNode *, GLRenderNode *);
     virtual void updatePerTansformNode(GLTransformNode *) {}
+    virtual void updateModelviewMatrix(const QMatrix4x4 &) {}
     virtual void updateRenderState(RenderState *);
 
+    // per frame uploads and binds, counted in the render statistics
+    template <typename T>
+    void setUniform(int location, const T &value) {
+        m_program.setUniformValue(location, value);
+        m_state->statistics.uniform_uploads++;
+    }
+    void bindTexture(QOpenGLTexture *texture, int unit);
+
 private:
     float m_opacity;
     int m_id_opacity;
@@ -56,13 +72,15 @@ private:
     void loadVertexBuffer(GLTransformNode *);
     void loadIndexBuffer(GLTransformNode *);
 
-    void renderNode(GLTransformNode *);
+    void drawMesh(Mesh *);
+    void setVertexBase(GLuint buffer, int base);
+    void setIndexBuffer(GLuint buffer);
 };
 
 class GLBasicShader : public GLShader
 {
 public:
-    GLBasicShader(bool has_texture);
+    GLBasicShader(bool has_texture, bool compact_vertex);
 
 protected:
     virtual void bind();
@@ -77,11 +95,13 @@ private:
 
     int m_id_texture_map;
     int m_id_combined_matrix;
+    int m_id_lod_bias;
 
     virtual QString vertexShader();
     virtual QString fragmentShader();
     virtual char const *const *attributeNames() const;
     virtual void updatePerTansformNode(GLTransformNode *);
+    virtual void updateModelviewMatrix(const QMatrix4x4 &modelview);
     virtual void updateRenderState(RenderState *);
 };
 
@@ -89,11 +109,13 @@ class GLPhongShader : public GLShader
 {
 public:
     GLPhongShader(const QList<Light *> *lights, bool has_diffuse_texture,
-                  bool has_specular_texture, bool has_env_map);
+                  bool has_specular_texture, bool has_env_map, bool compact_vertex);
+
+    virtual void updateLights();
 
 protected:
     const QList<Light *> *m_lights;
-    const int m_num_lights;
+    int m_num_lights;
 
     virtual void bind();
     virtual void release();
@@ -122,11 +144,13 @@ private:
     int m_id_specular_texture;
     int m_id_env_alpha;
     int m_id_env_map;
+    int m_id_lod_bias;
 
     virtual QString vertexShader();
     virtual QString fragmentShader();
     virtual char const *const *attributeNames() const;
     virtual void updatePerTansformNode(GLTransformNode *);
+    virtual void updateModelviewMatrix(const QMatrix4x4 &modelview);
     virtual void updateRenderState(RenderState *);
 };
 
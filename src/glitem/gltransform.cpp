@@ -1,6 +1,14 @@
 #include "gltransform.h"
 
 
+void GLTransform::applyToAffine(Affine3x4 *matrix) const
+{
+    QMatrix4x4 m;
+    matrix->toMatrix(m);
+    applyTo(&m);
+    *matrix = Affine3x4::fromMatrix(m);
+}
+
 GLScaleBase::GLScaleBase(QObject *parent)
     : GLTransform(parent), m_origin(0, 0, 0), m_scale(1, 1, 1)
 {
@@ -32,6 +40,11 @@ void GLScaleBase::applyTo(QMatrix4x4 *matrix) const
     matrix->translate(-m_origin);
 }
 
+void GLScaleBase::applyToAffine(Affine3x4 *matrix) const
+{
+    Affine3x4::multiply(*matrix, Affine3x4::scaling(m_scale, m_origin), *matrix);
+}
+
 GLScale::GLScale(QObject *parent)
     : GLScaleBase(parent)
 {
@@ -88,6 +101,11 @@ void GLTranslation::applyTo(QMatrix4x4 *matrix) const
     matrix->translate(m_translate * m_progress);
 }
 
+void GLTranslation::applyToAffine(Affine3x4 *matrix) const
+{
+    Affine3x4::multiply(*matrix, Affine3x4::translation(m_translate * m_progress), *matrix);
+}
+
 GLRotation::GLRotation(QObject *parent)
     : GLTransform(parent), m_origin(0, 0, 0), m_axis(0, 0, 1), m_angle(0)
 {
@@ -128,4 +146,9 @@ void GLRotation::applyTo(QMatrix4x4 *matrix) const
     matrix->translate(-m_origin);
 }
 
+void GLRotation::applyToAffine(Affine3x4 *matrix) const
+{
+    Affine3x4::multiply(*matrix, Affine3x4::rotation(m_angle, m_axis, m_origin), *matrix);
+}
+
 
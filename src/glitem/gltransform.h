@@ -3,6 +3,7 @@
 
 #include <QObject>
 #include <QMatrix4x4>
+#include "affine3x4.h"
 
 
 class GLTransform : public QObject
@@ -12,6 +13,9 @@ public:
     GLTransform(QObject *parent = 0) : QObject(parent) {}
 
     virtual void applyTo(QMatrix4x4 *matrix) const = 0;
+    // same on the scene store's affine matrices, goes through applyTo()
+    // unless a transform composes it directly
+    virtual void applyToAffine(Affine3x4 *matrix) const;
 
 signals:
     void transformChanged();
@@ -32,6 +36,7 @@ public:
     void setScale(const QVector3D &value);
 
     void applyTo(QMatrix4x4 *matrix) const;
+    void applyToAffine(Affine3x4 *matrix) const;
 
 signals:
     void originChanged();
@@ -71,6 +76,7 @@ public:
     void setProgress(float value);
 
     void applyTo(QMatrix4x4 *matrix) const;
+    void applyToAffine(Affine3x4 *matrix) const;
 
 signals:
     void translateChanged();
@@ -100,6 +106,7 @@ public:
     void setAxis(const QVector3D &value);
 
     void applyTo(QMatrix4x4 *matrix) const;
+    void applyToAffine(Affine3x4 *matrix) const;
 
 signals:
     void originChanged();
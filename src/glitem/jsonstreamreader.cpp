@@ -0,0 +1,295 @@
+#include "jsonstreamreader.h"
+#include <QIODevice>
+#include <qmath.h>
+
+
+static const int BUFFER_SIZE = 64 * 1024;
+// no number we accept is longer than this
+static const int MAX_NUMBER_LENGTH = 64;
+
+JsonStreamReader::JsonStreamReader(QIODevice *device)
+    : m_device(device), m_buffer(BUFFER_SIZE, 0),
+      m_pos(0), m_end(0), m_offset(0), m_eof(false), m_error(false),
+      m_number(0)
+{
+
+}
+
+bool JsonStreamReader::fill(int size)
+{
+    if (m_end - m_pos >= size || m_eof)
+        return m_pos < m_end;
+
+    char *data = m_buffer.data();
+    int remain = m_end - m_pos;
+    if (m_pos) {
+        memmove(data, data + m_pos, remain);
+        m_offset += m_pos;
+        m_pos = 0;
+        m_end = remain;
+    }
+
+    while (m_end < size && !m_eof) {
+        qint64 n = m_device->read(data + m_end, m_buffer.size() - m_end);
+        if (n > 0)
+            m_end += n;
+        else
+            m_eof = true;
+    }
+
+    return m_pos < m_end;
+}
+
+JsonStreamReader::Token JsonStreamReader::next()
+{
+    if (m_error)
+        return Invalid;
+
+    forever {
+        if (m_pos >= m_end && !fill(1))
+            return EndOfFile;
+
+        char c = m_buffer.constData()[m_pos];
+        switch (c) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case ',':
+        case ':':
+            m_pos++;
+            break;
+        case '{':
+            m_pos++;
+            return BeginObject;
+        case '}':
+            m_pos++;
+            return EndObject;
+        case '[':
+            m_pos++;
+            return BeginArray;
+        case ']':
+            m_pos++;
+            return EndArray;
+        case '"':
+            m_pos++;
+            return readString() ? String : Invalid;
+        default:
+            if (c == '-' || (c >= '0' && c <= '9'))
+                return readNumber() ? Number : Invalid;
+            if (c >= 'a' && c <= 'z')
+                return readLiteral() ? Literal : Invalid;
+            m_error = true;
+            return Invalid;
+        }
+    }
+}
+
+bool JsonStreamReader::readString()
+{
+    m_string.clear();
+
+    forever {
+        if (m_pos >= m_end && !fill(1)) {
+            m_error = true;
+            return false;
+        }
+
+        const char *data = m_buffer.constData();
+        int start = m_pos;
+        while (m_pos < m_end && data[m_pos] != '"' && data[m_pos] != '\\')
+            m_pos++;
+        m_string.append(data + start, m_pos - start);
+
+        if (m_pos >= m_end)
+            continue;
+
+        if (data[m_pos++] == '"')
+            return true;
+
+        // escape sequence
+        if (!fill(5)) {
+            m_error = true;
+            return false;
+        }
+
+        data = m_buffer.constData();
+        char c = data[m_pos++];
+        switch (c) {
+        case 'b': m_string.append('\b'); break;
+        case 'f': m_string.append('\f'); break;
+        case 'n': m_string.append('\n'); break;
+        case 'r': m_string.append('\r'); break;
+        case 't': m_string.append('\t'); break;
+        case 'u':
+            if (m_end - m_pos < 4) {
+                m_error = true;
+                return false;
+            }
+            else {
+                bool ok;
+                uint code = QByteArray(data + m_pos, 4).toUInt(&ok, 16);
+                m_string.append(ok && code < 0x80 ? char(code) : '?');
+                m_pos += 4;
+            }
+            break;
+        default:
+            m_string.append(c);
+            break;
+        }
+    }
+}
+
+bool JsonStreamReader::readNumber()
+{
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    // more digits than this can't change a float
+    static const quint64 max_mantissa = Q_UINT64_C(100000000000000000);
+
+    fill(MAX_NUMBER_LENGTH);
+
+    const char *data = m_buffer.constData();
+    const char *p = data + m_pos;
+    const char *end = data + m_end;
+
+    bool negative = false;
+    if (*p == '-') {
+        negative = true;
+        p++;
+    }
+
+    quint64 mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (mantissa < max_mantissa)
+            mantissa = mantissa * 10 + (*p - '0');
+        else
+            exponent++;
+        digits = true;
+        p++;
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (mantissa < max_mantissa) {
+                mantissa = mantissa * 10 + (*p - '0');
+                exponent--;
+            }
+            digits = true;
+            p++;
+        }
+    }
+
+    if (!digits) {
+        m_error = true;
+        return false;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool eneg = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            eneg = *p == '-';
+            p++;
+        }
+        int e = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (e < 10000)
+                e = e * 10 + (*p - '0');
+            p++;
+        }
+        exponent += eneg ? -e : e;
+    }
+
+    double value = mantissa;
+    if (exponent < 0) {
+        if (exponent >= -22)
+            value /= powers[-exponent];
+        else
+            value *= qPow(10.0, exponent);
+    }
+    else if (exponent > 0) {
+        if (exponent <= 22)
+            value *= powers[exponent];
+        else
+            value *= qPow(10.0, exponent);
+    }
+
+    m_number = negative ? -value : value;
+    m_pos = p - data;
+    return true;
+}
+
+bool JsonStreamReader::readLiteral()
+{
+    fill(MAX_NUMBER_LENGTH);
+
+    const char *data = m_buffer.constData();
+    int start = m_pos;
+    while (m_pos < m_end && data[m_pos] >= 'a' && data[m_pos] <= 'z')
+        m_pos++;
+
+    m_string = QByteArray(data + start, m_pos - start);
+    if (m_string == "true")
+        m_number = 1;
+    else if (m_string == "false" || m_string == "null")
+        m_number = 0;
+    else {
+        m_error = true;
+        return false;
+    }
+    return true;
+}
+
+bool JsonStreamReader::readNumbers(Token token, QVector<float> &values)
+{
+    if (token != BeginArray) {
+        m_error = true;
+        return false;
+    }
+
+    forever {
+        Token token = next();
+        if (token == EndArray)
+            return true;
+
+        if (token != Number) {
+            m_error = true;
+            return false;
+        }
+        values.append(m_number);
+    }
+}
+
+bool JsonStreamReader::skip(Token token)
+{
+    int depth = 0;
+    forever {
+        switch (token) {
+        case BeginObject:
+        case BeginArray:
+            depth++;
+            break;
+        case EndObject:
+        case EndArray:
+            depth--;
+            break;
+        case Invalid:
+        case EndOfFile:
+            m_error = true;
+            return false;
+        default:
+            break;
+        }
+
+        if (depth <= 0)
+            return true;
+
+        token = next();
+    }
+}
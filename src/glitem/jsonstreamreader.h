@@ -0,0 +1,62 @@
+#ifndef JSONSTREAMREADER_H
+#define JSONSTREAMREADER_H
+
+#include <QByteArray>
+#include <QVector>
+
+class QIODevice;
+
+// Pull tokenizer reading JSON from a device in fixed size chunks,
+// so large documents are never held in memory as a whole.
+class JsonStreamReader
+{
+public:
+    enum Token {
+        Invalid,
+        BeginObject,
+        EndObject,
+        BeginArray,
+        EndArray,
+        String,
+        Number,
+        Literal,
+        EndOfFile
+    };
+
+    JsonStreamReader(QIODevice *device);
+
+    // return next token, separators are skipped
+    Token next();
+
+    const QByteArray &string() const { return m_string; }
+    double number() const { return m_number; }
+
+    // read a whole array of numbers, the array must be the next value
+    bool readNumbers(QVector<float> &values) { return readNumbers(next(), values); }
+    // read the array of numbers starting with token
+    bool readNumbers(Token token, QVector<float> &values);
+    // skip the value starting with token
+    bool skip(Token token);
+
+    bool hasError() const { return m_error; }
+    qint64 offset() const { return m_offset + m_pos; }
+
+private:
+    QIODevice *m_device;
+    QByteArray m_buffer;
+    int m_pos;
+    int m_end;
+    qint64 m_offset;
+    bool m_eof;
+    bool m_error;
+
+    QByteArray m_string;
+    double m_number;
+
+    bool fill(int size);
+    bool readString();
+    bool readNumber();
+    bool readLiteral();
+};
+
+#endif // JSONSTREAMREADER_H
@@ -0,0 +1,623 @@
+#include "ktximage.h"
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QFileInfo>
+#include <QDebug>
+
+#define COMPRESSED_RGB_S3TC_DXT1        0x83F0
+#define COMPRESSED_RGBA_S3TC_DXT1       0x83F1
+#define COMPRESSED_RGBA_S3TC_DXT3       0x83F2
+#define COMPRESSED_RGBA_S3TC_DXT5       0x83F3
+#define ETC1_RGB8                       0x8D64
+#define COMPRESSED_RGB8_ETC2            0x9274
+#define COMPRESSED_RGBA8_ETC2_EAC       0x9278
+#define COMPRESSED_RGBA_ASTC_4x4        0x93B0
+#define COMPRESSED_RGBA_ASTC_12x12      0x93BD
+
+static const uchar ktx1_identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+static const uchar ktx2_identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+static quint32 readU32(const uchar *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (quint32(p[3]) << 24);
+}
+
+static quint64 readU64(const uchar *p)
+{
+    return readU32(p) | (quint64(readU32(p + 4)) << 32);
+}
+
+static qint64 align4(qint64 value)
+{
+    return (value + 3) & ~qint64(3);
+}
+
+static bool blockInfo(GLenum format, int &bw, int &bh, int &bytes)
+{
+    static const int astc[14][2] = {
+        {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+        {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}
+    };
+
+    switch (format) {
+    case COMPRESSED_RGB_S3TC_DXT1:
+    case COMPRESSED_RGBA_S3TC_DXT1:
+    case ETC1_RGB8:
+    case COMPRESSED_RGB8_ETC2:
+        bw = bh = 4;
+        bytes = 8;
+        return true;
+    case COMPRESSED_RGBA_S3TC_DXT3:
+    case COMPRESSED_RGBA_S3TC_DXT5:
+    case COMPRESSED_RGBA8_ETC2_EAC:
+        bw = bh = 4;
+        bytes = 16;
+        return true;
+    default:
+        if (format >= COMPRESSED_RGBA_ASTC_4x4 && format <= COMPRESSED_RGBA_ASTC_12x12) {
+            bw = astc[format - COMPRESSED_RGBA_ASTC_4x4][0];
+            bh = astc[format - COMPRESSED_RGBA_ASTC_4x4][1];
+            bytes = 16;
+            return true;
+        }
+        return false;
+    }
+}
+
+KtxImage::KtxImage()
+    : m_data(0), m_size(0), m_width(0), m_height(0), m_faces(1),
+      m_compressed(false), m_internal_format(0)
+{
+
+}
+
+bool KtxImage::isKtx(const QString &path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "ktx" || suffix == "ktx2";
+}
+
+bool KtxImage::load(const QString &path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qWarning() << "can't open ktx file: " << path;
+        return false;
+    }
+
+    m_size = m_file.size();
+    m_data = m_size >= 80 ? m_file.map(0, m_size) : 0;
+    if (!m_data) {
+        qWarning() << "can't map ktx file: " << path;
+        return false;
+    }
+
+    bool ok;
+    if (!memcmp(m_data, ktx1_identifier, 12))
+        ok = parseKtx1();
+    else if (!memcmp(m_data, ktx2_identifier, 12))
+        ok = parseKtx2();
+    else
+        ok = false;
+
+    if (!ok || !checkLevels()) {
+        qWarning() << "unsupported ktx file: " << path;
+        m_levels.clear();
+        return false;
+    }
+    return true;
+}
+
+bool KtxImage::parseKtx1()
+{
+    const uchar *h = m_data + 12;
+    if (readU32(h) != 0x04030201)
+        return false;
+
+    quint32 type = readU32(h + 4);
+    quint32 format = readU32(h + 12);
+    quint32 internal_format = readU32(h + 16);
+    m_width = readU32(h + 24);
+    m_height = readU32(h + 28);
+    quint32 depth = readU32(h + 32);
+    quint32 array_elements = readU32(h + 36);
+    m_faces = readU32(h + 40);
+    quint32 levels = qMax(readU32(h + 44), quint32(1));
+    quint32 kv_size = readU32(h + 48);
+
+    if (depth > 1 || array_elements || (m_faces != 1 && m_faces != 6))
+        return false;
+
+    if (!type) {
+        int bw, bh, bytes;
+        if (!blockInfo(internal_format, bw, bh, bytes))
+            return false;
+        m_compressed = true;
+        m_internal_format = internal_format;
+    }
+    else if (type == GL_UNSIGNED_BYTE && format == GL_RGBA)
+        m_internal_format = GL_RGBA;
+    else
+        return false;
+
+    qint64 pos = 64 + kv_size;
+    for (quint32 i = 0; i < levels; i++) {
+        if (pos + 4 > m_size)
+            return false;
+
+        Level level;
+        level.size = readU32(m_data + pos);
+        level.offset = pos + 4;
+        // faces of a cube map are padded to 4 bytes
+        level.stride = m_faces == 6 ? align4(level.size) : level.size;
+        m_levels.append(level);
+
+        pos = align4(level.offset + level.stride * m_faces);
+    }
+    return true;
+}
+
+bool KtxImage::parseKtx2()
+{
+    static const struct {
+        quint32 vk_format;
+        GLenum gl_format;
+    } formats[] = {
+        { 131, COMPRESSED_RGB_S3TC_DXT1 },
+        { 133, COMPRESSED_RGBA_S3TC_DXT1 },
+        { 135, COMPRESSED_RGBA_S3TC_DXT3 },
+        { 137, COMPRESSED_RGBA_S3TC_DXT5 },
+        { 147, COMPRESSED_RGB8_ETC2 },
+        { 151, COMPRESSED_RGBA8_ETC2_EAC }
+    };
+
+    const uchar *h = m_data + 12;
+    quint32 vk_format = readU32(h);
+    m_width = readU32(h + 8);
+    m_height = readU32(h + 12);
+    quint32 depth = readU32(h + 16);
+    quint32 layers = readU32(h + 20);
+    m_faces = readU32(h + 24);
+    quint32 levels = qMax(readU32(h + 28), quint32(1));
+    quint32 supercompression = readU32(h + 32);
+
+    // basis and zstd supercompression need a transcoder
+    if (depth > 1 || layers || supercompression || (m_faces != 1 && m_faces != 6))
+        return false;
+
+    if (vk_format == 37) {
+        // VK_FORMAT_R8G8B8A8_UNORM
+        m_internal_format = GL_RGBA;
+    }
+    else if (vk_format >= 157 && vk_format <= 184) {
+        // ASTC formats, odd ones are unorm and even ones srgb
+        if (!(vk_format & 1)) {
+            qWarning() << "sRGB ASTC textures are not supported: " << m_file.fileName();
+            return false;
+        }
+        m_internal_format = COMPRESSED_RGBA_ASTC_4x4 + (vk_format - 157) / 2;
+        m_compressed = true;
+    }
+    else {
+        for (uint i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+            if (formats[i].vk_format == vk_format) {
+                m_internal_format = formats[i].gl_format;
+                m_compressed = true;
+            }
+        }
+        if (!m_compressed)
+            return false;
+    }
+
+    // the level index comes from the file, don't let it wrap
+    if (80 + quint64(levels) * 24 > quint64(m_size))
+        return false;
+
+    for (quint32 i = 0; i < levels; i++) {
+        const uchar *index = m_data + 80 + i * 24;
+        quint64 offset = readU64(index);
+        quint64 length = readU64(index + 8);
+        if (offset > quint64(m_size) || length > quint64(m_size) - offset)
+            return false;
+
+        Level level;
+        level.offset = offset;
+        level.size = length / m_faces;
+        level.stride = level.size;
+        m_levels.append(level);
+    }
+    return true;
+}
+
+bool KtxImage::checkLevels()
+{
+    // no more levels than a mip chain of int sizes has
+    if (m_width <= 0 || m_height <= 0 || m_levels.isEmpty() || m_levels.size() > 32)
+        return false;
+
+    int bw = 1, bh = 1, bytes = 4;
+    if (m_compressed)
+        blockInfo(m_internal_format, bw, bh, bytes);
+
+    for (int i = 0; i < m_levels.size(); i++) {
+        const Level &level = m_levels[i];
+        qint64 w = qMax(m_width >> i, 1);
+        qint64 h = qMax(m_height >> i, 1);
+        qint64 expect = ((w + bw - 1) / bw) * ((h + bh - 1) / bh) * bytes;
+        if (level.offset < 0 || level.stride < 0 || level.size < expect ||
+            level.offset + level.stride * (m_faces - 1) + level.size > m_size)
+            return false;
+    }
+    return true;
+}
+
+bool KtxImage::hasMipChain() const
+{
+    int levels = 1;
+    for (int size = qMax(m_width, m_height); size > 1; size >>= 1)
+        levels++;
+    return m_levels.size() == levels;
+}
+
+const uchar *KtxImage::data(int level, int face) const
+{
+    return m_data + m_levels[level].offset + m_levels[level].stride * face;
+}
+
+bool KtxImage::isSupported() const
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    QSurfaceFormat format = context->format();
+    bool etc2 = context->isOpenGLES() ?
+                format.majorVersion() >= 3 :
+                format.majorVersion() > 4 ||
+                (format.majorVersion() == 4 && format.minorVersion() >= 3) ||
+                context->hasExtension("GL_ARB_ES3_compatibility");
+
+    switch (m_internal_format) {
+    case GL_RGBA:
+        return true;
+    case COMPRESSED_RGB_S3TC_DXT1:
+    case COMPRESSED_RGBA_S3TC_DXT1:
+        return context->hasExtension("GL_EXT_texture_compression_s3tc") ||
+               context->hasExtension("GL_EXT_texture_compression_dxt1");
+    case COMPRESSED_RGBA_S3TC_DXT3:
+    case COMPRESSED_RGBA_S3TC_DXT5:
+        return context->hasExtension("GL_EXT_texture_compression_s3tc");
+    case ETC1_RGB8:
+        return etc2 || context->hasExtension("GL_OES_compressed_ETC1_RGB8_texture");
+    case COMPRESSED_RGB8_ETC2:
+    case COMPRESSED_RGBA8_ETC2_EAC:
+        return etc2;
+    default:
+        return context->hasExtension("GL_KHR_texture_compression_astc_ldr");
+    }
+}
+
+GLenum KtxImage::uploadFormat() const
+{
+    // ETC2 decoders take ETC1 data, GLES3 has no ETC1 enum without the extension
+    if (m_internal_format == ETC1_RGB8 &&
+        !QOpenGLContext::currentContext()->hasExtension("GL_OES_compressed_ETC1_RGB8_texture"))
+        return COMPRESSED_RGB8_ETC2;
+    return m_internal_format;
+}
+
+bool KtxImage::upload(QOpenGLFunctions *gl, GLenum target, int face) const
+{
+    GLenum format = uploadFormat();
+    for (int i = 0; i < m_levels.size(); i++) {
+        int w = qMax(m_width >> i, 1);
+        int h = qMax(m_height >> i, 1);
+        if (m_compressed)
+            gl->glCompressedTexImage2D(target, i, format, w, h, 0,
+                                       m_levels[i].size, data(i, face));
+        else
+            gl->glTexImage2D(target, i, GL_RGBA, w, h, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, data(i, face));
+    }
+    return gl->glGetError() == GL_NO_ERROR;
+}
+
+static inline uchar clamp255(int value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static quint64 readU64BE(const uchar *p)
+{
+    quint64 value = 0;
+    for (int i = 0; i < 8; i++)
+        value = (value << 8) | p[i];
+    return value;
+}
+
+// block output is 4x4 RGBA pixels, row major
+static void setPixel(uchar *block, int x, int y, int r, int g, int b)
+{
+    uchar *p = block + (y * 4 + x) * 4;
+    p[0] = clamp255(r);
+    p[1] = clamp255(g);
+    p[2] = clamp255(b);
+}
+
+static void decodeEtcPaint(quint64 b, const int paint[4][3], uchar *block)
+{
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int i = x * 4 + y;
+            int index = (((b >> (16 + i)) & 1) << 1) | ((b >> i) & 1);
+            setPixel(block, x, y, paint[index][0], paint[index][1], paint[index][2]);
+        }
+    }
+}
+
+static void decodeEtc(quint64 b, uchar *block, bool etc1)
+{
+    static const int modifiers[8][2] = {
+        {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}
+    };
+    static const int distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+
+    int base[2][3];
+    if (!((b >> 33) & 1)) {
+        // individual mode, two 4-bit colors
+        for (int c = 0; c < 3; c++) {
+            base[0][c] = ((b >> (60 - c * 8)) & 0xf) * 17;
+            base[1][c] = ((b >> (56 - c * 8)) & 0xf) * 17;
+        }
+    }
+    else {
+        // differential mode, ETC2 reuses the overflowing cases
+        int c1[3], c2[3];
+        for (int c = 0; c < 3; c++) {
+            int d = (b >> (56 - c * 8)) & 7;
+            c1[c] = (b >> (59 - c * 8)) & 0x1f;
+            c2[c] = c1[c] + (d >= 4 ? d - 8 : d);
+        }
+
+        if (!etc1 && (c2[0] < 0 || c2[0] > 31)) {
+            // T mode
+            int paint[4][3];
+            int r1 = (((b >> 59) & 3) << 2) | ((b >> 56) & 3);
+            int color1[3] = { r1 * 17, int((b >> 52) & 0xf) * 17, int((b >> 48) & 0xf) * 17 };
+            int color2[3] = { int((b >> 44) & 0xf) * 17, int((b >> 40) & 0xf) * 17,
+                              int((b >> 36) & 0xf) * 17 };
+            int d = distances[(((b >> 34) & 3) << 1) | ((b >> 32) & 1)];
+            for (int c = 0; c < 3; c++) {
+                paint[0][c] = color1[c];
+                paint[1][c] = color2[c] + d;
+                paint[2][c] = color2[c];
+                paint[3][c] = color2[c] - d;
+            }
+            decodeEtcPaint(b, paint, block);
+            return;
+        }
+
+        if (!etc1 && (c2[1] < 0 || c2[1] > 31)) {
+            // H mode
+            int paint[4][3];
+            int r1 = (b >> 59) & 0xf;
+            int g1 = (((b >> 56) & 7) << 1) | ((b >> 52) & 1);
+            int b1 = (((b >> 51) & 1) << 3) | ((b >> 47) & 7);
+            int r2 = (b >> 43) & 0xf;
+            int g2 = (b >> 39) & 0xf;
+            int b2 = (b >> 35) & 0xf;
+            int order = ((r1 << 8) | (g1 << 4) | b1) >= ((r2 << 8) | (g2 << 4) | b2);
+            int d = distances[(((b >> 34) & 1) << 2) | (((b >> 32) & 1) << 1) | order];
+            int color1[3] = { r1 * 17, g1 * 17, b1 * 17 };
+            int color2[3] = { r2 * 17, g2 * 17, b2 * 17 };
+            for (int c = 0; c < 3; c++) {
+                paint[0][c] = color1[c] + d;
+                paint[1][c] = color1[c] - d;
+                paint[2][c] = color2[c] + d;
+                paint[3][c] = color2[c] - d;
+            }
+            decodeEtcPaint(b, paint, block);
+            return;
+        }
+
+        if (!etc1 && (c2[2] < 0 || c2[2] > 31)) {
+            // planar mode, colors interpolated from three corners
+            int o[3], hc[3], v[3];
+            o[0] = (b >> 57) & 0x3f;
+            o[1] = (((b >> 56) & 1) << 6) | ((b >> 49) & 0x3f);
+            o[2] = (((b >> 48) & 1) << 5) | (((b >> 43) & 3) << 3) | ((b >> 39) & 7);
+            hc[0] = (((b >> 34) & 0x1f) << 1) | ((b >> 32) & 1);
+            hc[1] = (b >> 25) & 0x7f;
+            hc[2] = (b >> 19) & 0x3f;
+            v[0] = (b >> 13) & 0x3f;
+            v[1] = (b >> 6) & 0x7f;
+            v[2] = b & 0x3f;
+            for (int c = 0; c < 3; c++) {
+                int bits = c == 1 ? 7 : 6;
+                o[c] = (o[c] << (8 - bits)) | (o[c] >> (2 * bits - 8));
+                hc[c] = (hc[c] << (8 - bits)) | (hc[c] >> (2 * bits - 8));
+                v[c] = (v[c] << (8 - bits)) | (v[c] >> (2 * bits - 8));
+            }
+            for (int y = 0; y < 4; y++) {
+                for (int x = 0; x < 4; x++) {
+                    int color[3];
+                    for (int c = 0; c < 3; c++)
+                        color[c] = (x * (hc[c] - o[c]) + y * (v[c] - o[c]) + 4 * o[c] + 2) >> 2;
+                    setPixel(block, x, y, color[0], color[1], color[2]);
+                }
+            }
+            return;
+        }
+
+        for (int c = 0; c < 3; c++) {
+            base[0][c] = (c1[c] << 3) | (c1[c] >> 2);
+            base[1][c] = (c2[c] << 3) | (c2[c] >> 2);
+        }
+    }
+
+    int table[2] = { int((b >> 37) & 7), int((b >> 34) & 7) };
+    bool flip = (b >> 32) & 1;
+    for (int x = 0; x < 4; x++) {
+        for (int y = 0; y < 4; y++) {
+            int i = x * 4 + y;
+            int sub = flip ? y >= 2 : x >= 2;
+            int m = modifiers[table[sub]][(b >> i) & 1];
+            if ((b >> (16 + i)) & 1)
+                m = -m;
+            setPixel(block, x, y, base[sub][0] + m, base[sub][1] + m, base[sub][2] + m);
+        }
+    }
+}
+
+static void decodeEacAlpha(quint64 a, uchar *block)
+{
+    static const int modifiers[16][8] = {
+        {-3, -6, -9, -15, 2, 5, 8, 14},
+        {-3, -7, -10, -13, 2, 6, 9, 12},
+        {-2, -5, -8, -13, 1, 4, 7, 12},
+        {-2, -4, -6, -13, 1, 3, 5, 12},
+        {-3, -6, -8, -12, 2, 5, 7, 11},
+        {-3, -7, -9, -11, 2, 6, 8, 10},
+        {-4, -7, -8, -11, 3, 6, 7, 10},
+        {-3, -5, -8, -11, 2, 4, 7, 10},
+        {-2, -6, -8, -10, 1, 5, 7, 9},
+        {-2, -5, -8, -10, 1, 4, 7, 9},
+        {-2, -4, -8, -10, 1, 3, 7, 9},
+        {-2, -5, -7, -10, 1, 4, 6, 9},
+        {-3, -4, -7, -10, 2, 3, 6, 9},
+        {-1, -2, -3, -10, 0, 1, 2, 9},
+        {-4, -6, -8, -9, 3, 5, 7, 8},
+        {-3, -5, -7, -9, 2, 4, 6, 8}
+    };
+
+    int base = (a >> 56) & 0xff;
+    int multiplier = (a >> 52) & 0xf;
+    const int *table = modifiers[(a >> 48) & 0xf];
+    for (int i = 0; i < 16; i++) {
+        int index = (a >> (45 - 3 * i)) & 7;
+        // pixels are stored column by column
+        block[((i % 4) * 4 + i / 4) * 4 + 3] = clamp255(base + table[index] * multiplier);
+    }
+}
+
+static void decodeDxtColor(const uchar *p, uchar *block, bool dxt1)
+{
+    int c[2] = { p[0] | (p[1] << 8), p[2] | (p[3] << 8) };
+    quint32 bits = readU32(p + 4);
+
+    int colors[4][4];
+    for (int i = 0; i < 2; i++) {
+        int r = (c[i] >> 11) & 0x1f, g = (c[i] >> 5) & 0x3f, b = c[i] & 0x1f;
+        colors[i][0] = (r << 3) | (r >> 2);
+        colors[i][1] = (g << 2) | (g >> 4);
+        colors[i][2] = (b << 3) | (b >> 2);
+        colors[i][3] = 255;
+    }
+
+    for (int j = 0; j < 3; j++) {
+        if (!dxt1 || c[0] > c[1]) {
+            colors[2][j] = (2 * colors[0][j] + colors[1][j]) / 3;
+            colors[3][j] = (colors[0][j] + 2 * colors[1][j]) / 3;
+        }
+        else {
+            colors[2][j] = (colors[0][j] + colors[1][j]) / 2;
+            colors[3][j] = 0;
+        }
+    }
+    colors[2][3] = 255;
+    colors[3][3] = !dxt1 || c[0] > c[1] ? 255 : 0;
+
+    for (int i = 0; i < 16; i++) {
+        const int *color = colors[(bits >> (2 * i)) & 3];
+        uchar *q = block + i * 4;
+        q[0] = color[0];
+        q[1] = color[1];
+        q[2] = color[2];
+        q[3] = color[3];
+    }
+}
+
+static void decodeDxt5Alpha(const uchar *p, uchar *block)
+{
+    int alpha[8];
+    alpha[0] = p[0];
+    alpha[1] = p[1];
+    if (alpha[0] > alpha[1]) {
+        for (int k = 2; k < 8; k++)
+            alpha[k] = ((8 - k) * alpha[0] + (k - 1) * alpha[1]) / 7;
+    }
+    else {
+        for (int k = 2; k < 6; k++)
+            alpha[k] = ((6 - k) * alpha[0] + (k - 1) * alpha[1]) / 5;
+        alpha[6] = 0;
+        alpha[7] = 255;
+    }
+
+    quint64 bits = readU32(p + 2) | (quint64(p[6] | (p[7] << 8)) << 32);
+    for (int i = 0; i < 16; i++)
+        block[i * 4 + 3] = alpha[(bits >> (3 * i)) & 7];
+}
+
+QImage KtxImage::decode(int face, int level) const
+{
+    if (level >= m_levels.size())
+        return QImage();
+
+    int width = qMax(m_width >> level, 1);
+    int height = qMax(m_height >> level, 1);
+    QImage image(width, height, QImage::Format_RGBA8888);
+    const uchar *src = data(level, face);
+
+    if (!m_compressed) {
+        for (int y = 0; y < height; y++)
+            memcpy(image.scanLine(y), src + y * width * 4, width * 4);
+        return image;
+    }
+
+    if (m_internal_format >= COMPRESSED_RGBA_ASTC_4x4 &&
+        m_internal_format <= COMPRESSED_RGBA_ASTC_12x12) {
+        qWarning() << "no CPU decoder for ASTC textures: " << m_file.fileName();
+        return QImage();
+    }
+
+    int bw, bh, bytes;
+    blockInfo(m_internal_format, bw, bh, bytes);
+
+    uchar block[4 * 4 * 4];
+    for (int by = 0; by < height; by += 4) {
+        for (int bx = 0; bx < width; bx += 4, src += bytes) {
+            memset(block, 255, sizeof(block));
+
+            switch (m_internal_format) {
+            case COMPRESSED_RGB_S3TC_DXT1:
+            case COMPRESSED_RGBA_S3TC_DXT1:
+                decodeDxtColor(src, block, true);
+                break;
+            case COMPRESSED_RGBA_S3TC_DXT3:
+                decodeDxtColor(src + 8, block, false);
+                for (int i = 0; i < 16; i++)
+                    block[i * 4 + 3] = ((src[i / 2] >> ((i & 1) * 4)) & 0xf) * 17;
+                break;
+            case COMPRESSED_RGBA_S3TC_DXT5:
+                decodeDxtColor(src + 8, block, false);
+                decodeDxt5Alpha(src, block);
+                break;
+            case ETC1_RGB8:
+            case COMPRESSED_RGB8_ETC2:
+                decodeEtc(readU64BE(src), block, m_internal_format == ETC1_RGB8);
+                break;
+            case COMPRESSED_RGBA8_ETC2_EAC:
+                decodeEtc(readU64BE(src + 8), block, false);
+                decodeEacAlpha(readU64BE(src), block);
+                break;
+            }
+
+            int w = qMin(4, width - bx), h = qMin(4, height - by);
+            for (int y = 0; y < h; y++)
+                memcpy(image.scanLine(by + y) + bx * 4, block + y * 16, w * 4);
+        }
+    }
+
+    return image;
+}
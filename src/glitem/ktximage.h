@@ -0,0 +1,68 @@
+#ifndef KTXIMAGE_H
+#define KTXIMAGE_H
+
+#include <QFile>
+#include <QImage>
+#include <QVector>
+#include <qopengl.h>
+
+class QOpenGLFunctions;
+
+// KTX and KTX2 texture container read through a file mapping. Block
+// compressed levels are handed to glCompressedTexImage2D as they are
+// in the file, contexts without the format get a CPU decoded image.
+class KtxImage
+{
+public:
+    KtxImage();
+
+    static bool isKtx(const QString &path);
+
+    bool load(const QString &path);
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int levels() const { return m_levels.size(); }
+    int faces() const { return m_faces; }
+    // whether the file stores every level down to 1x1
+    bool hasMipChain() const;
+    bool isCompressed() const { return m_compressed; }
+    GLenum internalFormat() const { return m_internal_format; }
+    qint64 dataSize() const { return m_size; }
+
+    // whether the current context can sample the stored format
+    bool isSupported() const;
+    // upload all levels of one face to target, a 2D texture or a cube
+    // map face, the texture must be bound
+    bool upload(QOpenGLFunctions *gl, GLenum target, int face = 0) const;
+    // decode a level of face to RGBA8888, rows in file order
+    QImage decode(int face = 0, int level = 0) const;
+
+private:
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+
+    int m_width;
+    int m_height;
+    int m_faces;
+    bool m_compressed;
+    GLenum m_internal_format;
+
+    struct Level {
+        qint64 offset;
+        // size of one face
+        qint64 size;
+        // distance between faces
+        qint64 stride;
+    };
+    QVector<Level> m_levels;
+
+    bool parseKtx1();
+    bool parseKtx2();
+    bool checkLevels();
+    const uchar *data(int level, int face) const;
+    GLenum uploadFormat() const;
+};
+
+#endif // KTXIMAGE_H
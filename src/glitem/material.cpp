@@ -1,67 +1,72 @@
 #include "material.h"
 #include "glshader.h"
+#include "texture.h"
 #include <QHash>
 
 
 Material::ShaderMap Material::m_shaders;
 
-bool Material::init(const QList<Light *> *, bool)
+// decoded texture of source, its placeholder while it's still decoding
+static QOpenGLTexture *initTexture(Texture *source)
 {
-    if (m_shader) {
-        if (m_transparent)
-            m_shader->hasTransparency();
-        else
-            m_shader->hasOpaque();
+    if (!source)
+        return 0;
+    return source->isDecoded() ? source->texture() : source->placeholder();
+}
+
+// replace texture once source is decoded, false until then
+static bool updateTexture(Texture *source, QOpenGLTexture *&texture)
+{
+    if (!source)
         return true;
-    }
-    return false;
+    if (!source->isDecoded())
+        return false;
+
+    // a texture that failed to decode keeps its placeholder
+    QOpenGLTexture *decoded = source->texture();
+    if (decoded)
+        texture = decoded;
+    return true;
+}
+
+bool Material::init(const QList<Light *> *, bool, bool)
+{
+    return m_shader != 0;
 }
 
 BasicMaterial::BasicMaterial()
-    : Material(), m_texture_image(0), m_texture(0)
+    : Material(), m_texture_source(0), m_texture(0)
 {
 
 }
 
 BasicMaterial::~BasicMaterial()
 {
-    if (m_texture_image)
-        delete m_texture_image;
-    if (m_texture)
-        delete m_texture;
+    if (m_texture_source)
+        Texture::release(m_texture_source);
 }
 
 bool BasicMaterial::loadTexture(const QString &path, QOpenGLTexture::WrapMode mode)
 {
-    QImage image;
-    if (image.load(path)) {
-        m_texture_image = new QImage(image.mirrored());
-        m_texture_mode = mode;
-        return true;
-    }
-    return false;
+    // decoding goes on in the background, init() picks up the result
+    m_texture_source = Texture::acquire(path, mode, m_texture_filter, m_anisotropy);
+    return m_texture_source != 0;
 }
 
-bool BasicMaterial::init(const QList<Light *> *a1, bool a2)
+bool BasicMaterial::init(const QList<Light *> *a1, bool a2, bool compact_vertex)
 {
-    if (m_texture_image) {
-        m_texture = new QOpenGLTexture(*m_texture_image);
-        m_texture->setMinificationFilter(QOpenGLTexture::Linear);
-        m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-        m_texture->setWrapMode(m_texture_mode);
-
-        delete m_texture_image;
-        m_texture_image = 0;
-    }
+    m_texture = initTexture(m_texture_source);
 
     uint key = 0x8000;
     if (m_texture)
         key |= 0x0100;
+    if (compact_vertex)
+        key |= 0x10000;
 
     bool ret;
     ShaderMap::iterator it = m_shaders.find(key);
     if (it == m_shaders.end()) {
-        m_shader = new GLBasicShader(m_texture != NULL);
+        m_shader = new GLBasicShader(m_texture != NULL, compact_vertex);
         m_shaders.insert(key, m_shader);
         ret = true;
     }
@@ -70,13 +75,18 @@ bool BasicMaterial::init(const QList<Light *> *a1, bool a2)
         ret = false;
     }
 
-    Material::init(a1, a2);
+    Material::init(a1, a2, compact_vertex);
     return ret;
 }
 
+bool BasicMaterial::updateTextures()
+{
+    return updateTexture(m_texture_source, m_texture);
+}
+
 PhongMaterial::PhongMaterial()
     : Material(), m_env_map(false),
-      m_diffuse_texture_image(0), m_specular_texture_image(0),
+      m_diffuse_texture_source(0), m_specular_texture_source(0),
       m_diffuse_texture(0), m_specular_texture(0)
 {
 
@@ -84,59 +94,28 @@ PhongMaterial::PhongMaterial()
 
 PhongMaterial::~PhongMaterial()
 {
-    if (m_diffuse_texture_image)
-        delete m_diffuse_texture_image;
-    if (m_specular_texture_image)
-        delete m_specular_texture_image;
-    if (m_diffuse_texture)
-        delete m_diffuse_texture;
-    if (m_specular_texture)
-        delete m_specular_texture;
+    if (m_diffuse_texture_source)
+        Texture::release(m_diffuse_texture_source);
+    if (m_specular_texture_source)
+        Texture::release(m_specular_texture_source);
 }
 
 bool PhongMaterial::loadDiffuseTexture(const QString &path, QOpenGLTexture::WrapMode mode)
 {
-    QImage image;
-    if (image.load(path)) {
-        m_diffuse_texture_image = new QImage(image.mirrored());
-        m_diffuse_texture_mode = mode;
-        return true;
-    }
-    return false;
+    m_diffuse_texture_source = Texture::acquire(path, mode, m_texture_filter, m_anisotropy);
+    return m_diffuse_texture_source != 0;
 }
 
 bool PhongMaterial::loadSpecularTexture(const QString &path, QOpenGLTexture::WrapMode mode)
 {
-    QImage image;
-    if (image.load(path)) {
-        m_specular_texture_image = new QImage(image.mirrored());
-        m_specular_texture_mode = mode;
-        return true;
-    }
-    return false;
+    m_specular_texture_source = Texture::acquire(path, mode, m_texture_filter, m_anisotropy);
+    return m_specular_texture_source != 0;
 }
 
-bool PhongMaterial::init(const QList<Light *> *lights, bool has_env_map)
+bool PhongMaterial::init(const QList<Light *> *lights, bool has_env_map, bool compact_vertex)
 {
-    if (m_diffuse_texture_image) {
-        m_diffuse_texture = new QOpenGLTexture(*m_diffuse_texture_image);
-        m_diffuse_texture->setMinificationFilter(QOpenGLTexture::Linear);
-        m_diffuse_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-        m_diffuse_texture->setWrapMode(m_diffuse_texture_mode);
-
-        delete m_diffuse_texture_image;
-        m_diffuse_texture_image = 0;
-    }
-
-    if (m_specular_texture_image) {
-        m_specular_texture = new QOpenGLTexture(*m_specular_texture_image);
-        m_specular_texture->setMinificationFilter(QOpenGLTexture::Linear);
-        m_specular_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-        m_specular_texture->setWrapMode(m_specular_texture_mode);
-
-        delete m_specular_texture_image;
-        m_specular_texture_image = 0;
-    }
+    m_diffuse_texture = initTexture(m_diffuse_texture_source);
+    m_specular_texture = initTexture(m_specular_texture_source);
 
     uint key = 0x80;
     if (m_diffuse_texture)
@@ -145,6 +124,8 @@ bool PhongMaterial::init(const QList<Light *> *lights, bool has_env_map)
         key |= 0x02;
     if (m_env_map && has_env_map)
         key |= 0x04;
+    if (compact_vertex)
+        key |= 0x10000;
 
     bool ret;
     ShaderMap::iterator it = m_shaders.find(key);
@@ -152,7 +133,8 @@ bool PhongMaterial::init(const QList<Light *> *lights, bool has_env_map)
         m_shader = new GLPhongShader(lights,
                                      m_diffuse_texture != NULL,
                                      m_specular_texture != NULL,
-                                     m_env_map && has_env_map);
+                                     m_env_map && has_env_map,
+                                     compact_vertex);
         m_shaders.insert(key, m_shader);
         ret = true;
     }
@@ -161,6 +143,13 @@ bool PhongMaterial::init(const QList<Light *> *lights, bool has_env_map)
         ret = false;
     }
 
-    Material::init(lights, has_env_map);
+    Material::init(lights, has_env_map, compact_vertex);
     return ret;
 }
+
+bool PhongMaterial::updateTextures()
+{
+    bool diffuse = updateTexture(m_diffuse_texture_source, m_diffuse_texture);
+    bool specular = updateTexture(m_specular_texture_source, m_specular_texture);
+    return diffuse && specular;
+}
@@ -3,15 +3,17 @@
 
 #include <QVector3D>
 #include <QOpenGLTexture>
+#include "texture.h"
 
-class QImage;
 class GLShader;
 class Light;
 
 class Material
 {
 public:
-    Material() : m_shader(0), m_transparent(0), m_opacity(1) {}
+    Material()
+        : m_shader(0), m_texture_filter(Texture::Trilinear), m_anisotropy(1),
+          m_transparent(0), m_opacity(1) {}
     virtual ~Material() {}
 
     GLShader *shader() { return m_shader; }
@@ -25,13 +27,28 @@ public:
     float opacity() const { return m_opacity; }
     void setOpacity(float value) { m_opacity = value; }
 
-    virtual bool init(const QList<Light *> *, bool);
+    // sampling of textures loaded after this is set
+    void setTextureFilter(Texture::Filter filter, float anisotropy) {
+        m_texture_filter = filter;
+        m_anisotropy = anisotropy;
+    }
+
+    virtual bool init(const QList<Light *> *, bool, bool);
+    // swap placeholders for textures decoded since init(), false while
+    // some are still decoding
+    virtual bool updateTextures() { return true; }
+    // textures bound for drawing, draws sharing them are sorted together
+    virtual QPair<QOpenGLTexture *, QOpenGLTexture *> textureSet() {
+        return qMakePair((QOpenGLTexture *)0, (QOpenGLTexture *)0);
+    }
 
 protected:
     typedef QHash<uint, GLShader *> ShaderMap;
     static ShaderMap m_shaders;
 
     GLShader *m_shader;
+    Texture::Filter m_texture_filter;
+    float m_anisotropy;
 
 private:
     QString m_name;
@@ -47,11 +64,14 @@ public:
     bool loadTexture(const QString &path, QOpenGLTexture::WrapMode mode);
     QOpenGLTexture *texture() { return m_texture; }
 
-    virtual bool init(const QList<Light *> *, bool);
+    virtual bool init(const QList<Light *> *, bool, bool);
+    virtual bool updateTextures();
+    virtual QPair<QOpenGLTexture *, QOpenGLTexture *> textureSet() {
+        return qMakePair(m_texture, (QOpenGLTexture *)0);
+    }
 
 private:
-    QImage *m_texture_image;
-    QOpenGLTexture::WrapMode m_texture_mode;
+    Texture *m_texture_source;
     QOpenGLTexture *m_texture;
 };
 
@@ -83,7 +103,11 @@ public:
 
     float env_alpha() { return m_env_alpha; }
 
-    virtual bool init(const QList<Light *> *lights, bool has_env_map);
+    virtual bool init(const QList<Light *> *lights, bool has_env_map, bool compact_vertex);
+    virtual bool updateTextures();
+    virtual QPair<QOpenGLTexture *, QOpenGLTexture *> textureSet() {
+        return qMakePair(m_diffuse_texture, m_specular_texture);
+    }
 
 private:
     QVector3D m_ka;
@@ -94,10 +118,8 @@ private:
     bool m_env_map;
     float m_env_alpha;
 
-    QImage *m_diffuse_texture_image;
-    QImage *m_specular_texture_image;
-    QOpenGLTexture::WrapMode m_diffuse_texture_mode;
-    QOpenGLTexture::WrapMode m_specular_texture_mode;
+    Texture *m_diffuse_texture_source;
+    Texture *m_specular_texture_source;
 
     QOpenGLTexture *m_diffuse_texture;
     QOpenGLTexture *m_specular_texture;
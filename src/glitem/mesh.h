@@ -1,10 +1,39 @@
 #ifndef MESH
 #define MESH
 
+#include <QVector>
+#include <QMatrix4x4>
+#include <qopengl.h>
+
 struct Mesh {
+    Mesh() : vertex_buffer(0), vertex_offset(0), index_buffer(0), index_type(0) {}
+
     enum Type { NORMAL, TEXTURED } type;
+    // in indices, not bytes
     int index_offset;
     int index_count;
+
+    // index ranges drawn relative to vertex_base, set up when the mesh's
+    // model is uploaded to the scene buffers, several ranges when its
+    // model is too large for 16-bit indices
+    struct Range {
+        int index_offset;
+        int index_count;
+        int vertex_base;
+    };
+    QVector<Range> ranges;
+
+    // buffer of a dynamic model the ranges are drawn from instead of the
+    // scene vertex buffer, vertex_offset is added to their vertex_base
+    GLuint vertex_buffer;
+    int vertex_offset;
+    // index buffer of a shared model instead of the scene one
+    GLuint index_buffer;
+    // type of the indices in index_buffer when not the scene's
+    GLenum index_type;
+
+    // folded into modelview when positions are stored quantized
+    QMatrix4x4 position_matrix;
 };
 
 #endif // MESH
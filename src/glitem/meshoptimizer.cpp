@@ -0,0 +1,214 @@
+#include "meshoptimizer.h"
+#include "geometry.h"
+#include <qmath.h>
+
+
+// LRU cache size the triangle scoring is tuned for
+static const int CACHE_SIZE = 32;
+static const int MAX_VALENCE = 32;
+
+class VertexScore
+{
+public:
+    VertexScore() {
+        for (int i = 0; i < CACHE_SIZE; i++) {
+            // the last triangle's vertices get a fixed score so it isn't
+            // better to reuse them right away than a bit later
+            if (i < 3)
+                m_cache[i] = 0.75f;
+            else
+                m_cache[i] = qPow(1.0f - float(i - 3) / (CACHE_SIZE - 3), 1.5f);
+        }
+
+        // favour vertices with few triangles left to get rid of them
+        for (int i = 0; i < MAX_VALENCE; i++)
+            m_valence[i] = i ? 2.0f / qSqrt(i) : 0;
+    }
+
+    float score(int cache_pos, int remaining) const {
+        if (!remaining)
+            return -1;
+
+        float score = cache_pos >= 0 ? m_cache[cache_pos] : 0;
+        if (remaining < MAX_VALENCE)
+            score += m_valence[remaining];
+        else
+            score += 2.0f / qSqrt(remaining);
+        return score;
+    }
+
+private:
+    float m_cache[CACHE_SIZE];
+    float m_valence[MAX_VALENCE];
+};
+
+void MeshOptimizer::optimize(Geometry &geometry, QVector<Mesh> &meshes)
+{
+    for (int i = 0; i < meshes.size(); i++)
+        optimizeVertexCache(geometry.indices() + meshes[i].index_offset, meshes[i].index_count);
+
+    optimizeVertexFetch(geometry);
+}
+
+void MeshOptimizer::optimizeVertexCache(uint *index, int count)
+{
+    static const VertexScore vertex_score;
+
+    int ntri = count / 3;
+    if (ntri < 2)
+        return;
+
+    // work on the vertex range used by this mesh only
+    uint low = UINT_MAX, high = 0;
+    for (int i = 0; i < count; i++) {
+        low = qMin(low, index[i]);
+        high = qMax(high, index[i]);
+    }
+    int nv = high - low + 1;
+
+    QVector<uint> input(count);
+    for (int i = 0; i < count; i++)
+        input[i] = index[i] - low;
+
+    // triangles using each vertex, the first remaining[v] entries
+    // of a vertex's list are the ones not emitted yet
+    QVector<int> remaining(nv, 0);
+    for (int i = 0; i < count; i++)
+        remaining[input[i]]++;
+
+    QVector<int> offset(nv + 1);
+    offset[0] = 0;
+    for (int i = 0; i < nv; i++)
+        offset[i + 1] = offset[i] + remaining[i];
+
+    QVector<int> adjacency(count);
+    QVector<int> fill = offset;
+    for (int i = 0; i < count; i++)
+        adjacency[fill[input[i]]++] = i / 3;
+
+    QVector<int> cache_pos(nv, -1);
+    QVector<float> score(nv);
+    for (int i = 0; i < nv; i++)
+        score[i] = vertex_score.score(-1, remaining[i]);
+
+    QVector<float> tri_score(ntri);
+    QVector<bool> emitted(ntri, false);
+    int best = 0;
+    for (int i = 0; i < ntri; i++) {
+        const uint *t = input.constData() + i * 3;
+        tri_score[i] = score[t[0]] + score[t[1]] + score[t[2]];
+        if (tri_score[i] > tri_score[best])
+            best = i;
+    }
+
+    int cache[CACHE_SIZE + 3];
+    int cache_count = 0;
+    int scan = 0;
+
+    for (int n = 0; n < ntri; n++) {
+        if (best < 0) {
+            // nothing in the cache is connected, restart from the next
+            // triangle in input order
+            while (emitted[scan])
+                scan++;
+            best = scan;
+        }
+
+        emitted[best] = true;
+        const uint *t = input.constData() + best * 3;
+        for (int j = 0; j < 3; j++)
+            index[n * 3 + j] = t[j] + low;
+
+        // push triangle vertices to the front of the cache
+        int new_cache[CACHE_SIZE + 3];
+        int new_count = 0;
+        for (int j = 0; j < 3; j++) {
+            int v = t[j];
+            int *adj = adjacency.data() + offset[v];
+            int last = --remaining[v];
+            for (int k = 0; k <= last; k++) {
+                if (adj[k] == best) {
+                    adj[k] = adj[last];
+                    adj[last] = best;
+                    break;
+                }
+            }
+
+            if (j == 0 || (j == 1 && v != (int)t[0]) ||
+                (j == 2 && v != (int)t[0] && v != (int)t[1]))
+                new_cache[new_count++] = v;
+        }
+
+        for (int k = 0; k < cache_count; k++) {
+            int v = cache[k];
+            if (v != (int)t[0] && v != (int)t[1] && v != (int)t[2])
+                new_cache[new_count++] = v;
+        }
+
+        for (int k = 0; k < new_count; k++) {
+            int v = new_cache[k];
+            cache_pos[v] = k < CACHE_SIZE ? k : -1;
+            score[v] = vertex_score.score(cache_pos[v], remaining[v]);
+        }
+
+        // only triangles around cached or just evicted vertices change
+        best = -1;
+        float best_score = -1;
+        for (int k = 0; k < new_count; k++) {
+            int v = new_cache[k];
+            const int *adj = adjacency.constData() + offset[v];
+            for (int a = 0; a < remaining[v]; a++) {
+                int tri = adj[a];
+                const uint *tv = input.constData() + tri * 3;
+                tri_score[tri] = score[tv[0]] + score[tv[1]] + score[tv[2]];
+                if (tri_score[tri] > best_score) {
+                    best_score = tri_score[tri];
+                    best = tri;
+                }
+            }
+        }
+
+        cache_count = qMin(new_count, CACHE_SIZE);
+        memcpy(cache, new_cache, cache_count * sizeof(int));
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(Geometry &geometry)
+{
+    QVector<int> remap(geometry.vertexCount(), -1);
+    QVector<Vertex> vertices;
+    vertices.reserve(geometry.vertexCount());
+
+    const Vertex *source = geometry.vertices();
+    uint *index = geometry.indices();
+    for (int i = 0; i < geometry.indexCount(); i++) {
+        uint v = index[i];
+        if (remap[v] < 0) {
+            remap[v] = vertices.size();
+            vertices.append(source[v]);
+        }
+        index[i] = remap[v];
+    }
+
+    geometry.vertexArray().swap(vertices);
+}
+
+float MeshOptimizer::acmr(const uint *index, int count, int nvertex, int cache_size)
+{
+    if (count < 3)
+        return 0;
+
+    // a vertex is still cached while fewer than cache_size
+    // misses happened after it was loaded
+    QVector<int> loaded(nvertex, -1);
+    int misses = 0;
+    for (int i = 0; i < count; i++) {
+        uint v = index[i];
+        if (loaded[v] < 0 || misses - loaded[v] > cache_size) {
+            loaded[v] = misses;
+            misses++;
+        }
+    }
+
+    return float(misses) / (count / 3);
+}
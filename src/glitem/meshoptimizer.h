@@ -0,0 +1,27 @@
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <QVector>
+#include "mesh.h"
+
+class Geometry;
+
+// Reorder model geometry for the GPU vertex caches: triangles are
+// sorted for post-transform cache reuse (Forsyth) and vertices are
+// then laid out in the order the triangles first fetch them.
+class MeshOptimizer
+{
+public:
+    static void optimize(Geometry &geometry, QVector<Mesh> &meshes);
+
+    // reorder triangles of one index range in place
+    static void optimizeVertexCache(uint *index, int count);
+    // reorder vertices by first use and drop unreferenced ones
+    static void optimizeVertexFetch(Geometry &geometry);
+
+    // average cache miss ratio (transformed vertices per triangle)
+    // of a FIFO cache, the kind found in most GLES parts
+    static float acmr(const uint *index, int count, int nvertex, int cache_size = 16);
+};
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,163 @@
+#include "modelcache.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QDir>
+#include <QDebug>
+
+
+const quint32 ModelCache::m_magic;
+const quint32 ModelCache::m_version;
+
+ModelCache::ModelCache(const QString &source, const QString &tag)
+    : m_source(source), m_data(0), m_pos(0), m_size(0)
+{
+    QFileInfo info(source);
+    QString key = info.exists() ? info.absoluteFilePath() : source;
+    key += '|' + tag;
+
+    QString name = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex();
+    m_input.setFileName(cacheDir() + '/' + name + ".bin");
+    m_output.setFileName(m_input.fileName());
+
+    m_header.magic = m_magic;
+    m_header.version = m_version;
+    m_header.source_size = info.size();
+    // resources change only with the application binary
+    if (source.startsWith(':'))
+        info.setFile(QCoreApplication::applicationFilePath());
+    m_header.source_mtime = info.lastModified().toMSecsSinceEpoch();
+}
+
+QString ModelCache::cacheDir()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/glitem";
+}
+
+bool ModelCache::open()
+{
+    if (!m_input.open(QIODevice::ReadOnly))
+        return false;
+
+    m_size = m_input.size();
+    if (m_size < (qint64)sizeof(Header))
+        return false;
+
+    m_data = m_input.map(0, m_size);
+    if (!m_data) {
+        qWarning() << "can't map model cache: " << m_input.fileName();
+        return false;
+    }
+
+    const Header *header = (const Header *)m_data;
+    if (header->magic != m_header.magic ||
+        header->version != m_header.version ||
+        header->source_size != m_header.source_size ||
+        header->source_mtime != m_header.source_mtime)
+        return false;
+
+    m_pos = sizeof(Header);
+    return true;
+}
+
+bool ModelCache::create()
+{
+    if (!QDir().mkpath(cacheDir()) ||
+        !m_output.open(QIODevice::WriteOnly)) {
+        qWarning() << "can't create model cache: " << m_output.fileName();
+        return false;
+    }
+
+    m_output.write((const char *)&m_header, sizeof(Header));
+    return true;
+}
+
+bool ModelCache::commit()
+{
+    if (!m_output.commit()) {
+        qWarning() << "can't write model cache: " << m_output.fileName();
+        return false;
+    }
+    return true;
+}
+
+bool ModelCache::readInt(int &value)
+{
+    if (m_pos + (qint64)sizeof(qint64) > m_size)
+        return false;
+
+    value = *(const qint64 *)(m_data + m_pos);
+    m_pos += sizeof(qint64);
+    return true;
+}
+
+void ModelCache::writeInt(int value)
+{
+    qint64 v = value;
+    m_output.write((const char *)&v, sizeof(v));
+}
+
+bool ModelCache::readFloats(float *values, int count)
+{
+    const float *data;
+    int n;
+    if (!readArray((const void **)&data, n, sizeof(float)) || n != count)
+        return false;
+    memcpy(values, data, count * sizeof(float));
+    return true;
+}
+
+void ModelCache::writeFloats(const float *values, int count)
+{
+    writeArrayHeader(count, sizeof(float));
+    m_output.write((const char *)values, count * sizeof(float));
+    writePadding(count * sizeof(float));
+}
+
+bool ModelCache::readString(QString &value)
+{
+    const char *data;
+    int size;
+    if (!readArray((const void **)&data, size, 1))
+        return false;
+    value = QString::fromUtf8(data, size);
+    return true;
+}
+
+void ModelCache::writeString(const QString &value)
+{
+    QByteArray data = value.toUtf8();
+    writeArrayHeader(data.size(), 1);
+    m_output.write(data.constData(), data.size());
+    writePadding(data.size());
+}
+
+bool ModelCache::readArray(const void **data, int &count, int size)
+{
+    int esize;
+    if (!readInt(count) || !readInt(esize) || esize != size)
+        return false;
+
+    qint64 bytes = (qint64)count * size;
+    if (count < 0 || m_pos + bytes > m_size)
+        return false;
+
+    *data = m_data + m_pos;
+    m_pos += (bytes + 7) & ~7;
+    return true;
+}
+
+void ModelCache::writeArrayHeader(int count, int size)
+{
+    writeInt(count);
+    writeInt(size);
+}
+
+void ModelCache::writePadding(qint64 size)
+{
+    static const char zero[8] = { 0 };
+    if (size & 7)
+        m_output.write(zero, 8 - (size & 7));
+}
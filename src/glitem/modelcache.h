@@ -0,0 +1,94 @@
+#ifndef MODELCACHE_H
+#define MODELCACHE_H
+
+#include <QFile>
+#include <QSaveFile>
+#include <QList>
+#include <QVector>
+
+// Binary cache of loader output stored next to the user cache directory.
+// A cache file is keyed by the source path and a loader specific tag and
+// is only used while the source file keeps the same size and mtime.
+class ModelCache
+{
+public:
+    ModelCache(const QString &source, const QString &tag);
+
+    // map an existing cache file, fail when absent or out of date
+    bool open();
+    // start writing a new cache file for the source
+    bool create();
+    // finish writing and atomically replace the old cache file
+    bool commit();
+
+    bool readInt(int &value);
+    void writeInt(int value);
+
+    bool readFloats(float *values, int count);
+    void writeFloats(const float *values, int count);
+
+    bool readString(QString &value);
+    void writeString(const QString &value);
+
+    template <typename T> bool read(QList<T> &list) {
+        const T *data;
+        int count;
+        if (!readArray((const void **)&data, count, sizeof(T)))
+            return false;
+        list.reserve(count);
+        for (int i = 0; i < count; i++)
+            list.append(data[i]);
+        return true;
+    }
+
+    template <typename T> bool read(QVector<T> &vector) {
+        const T *data;
+        int count;
+        if (!readArray((const void **)&data, count, sizeof(T)))
+            return false;
+        vector.resize(count);
+        memcpy(vector.data(), data, count * sizeof(T));
+        return true;
+    }
+
+    template <typename T> void write(const QList<T> &list) {
+        writeArrayHeader(list.size(), sizeof(T));
+        for (int i = 0; i < list.size(); i++)
+            m_output.write((const char *)&list[i], sizeof(T));
+        writePadding(list.size() * sizeof(T));
+    }
+
+    template <typename T> void write(const QVector<T> &vector) {
+        writeArrayHeader(vector.size(), sizeof(T));
+        m_output.write((const char *)vector.constData(), vector.size() * sizeof(T));
+        writePadding(vector.size() * sizeof(T));
+    }
+
+    static QString cacheDir();
+
+private:
+    struct Header {
+        quint32 magic;
+        quint32 version;
+        qint64 source_size;
+        qint64 source_mtime;
+    };
+
+    static const quint32 m_magic = 0x434d4c47; // "GLMC"
+    static const quint32 m_version = 3;
+
+    QString m_source;
+    QFile m_input;
+    QSaveFile m_output;
+    Header m_header;
+
+    const uchar *m_data;
+    qint64 m_pos;
+    qint64 m_size;
+
+    bool readArray(const void **data, int &count, int size);
+    void writeArrayHeader(int count, int size);
+    void writePadding(qint64 size);
+};
+
+#endif // MODELCACHE_H
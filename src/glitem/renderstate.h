@@ -2,35 +2,80 @@
 #define RENDERSTATE
 
 #include <QMatrix4x4>
+#include <QAtomicInt>
+#include <qopengl.h>
 #include "light.h"
 
 class QOpenGLTexture;
 
 struct RenderState {
     QMatrix4x4 projection_matrix;
+    // changes with the projection matrix, unique over all renders since
+    // nodes caching products with it outlive them
+    int projection_serial;
     float opacity;
     bool visible;
 
     QOpenGLTexture *envmap;
     QVector3D light_amb;
+    // added to the mip level of every texture lookup
+    float lod_bias;
 
     struct RSLight {
         Light *light;
         QVector3D final_pos;
         bool final_pos_dirty;
+        // light position and node state final_pos is computed for
+        QVector3D pos;
+        GLTransformNode *node;
+        int node_revision;
     };
     QVector<RSLight> lights;
 
+    // layout of the scene vertex and index buffers
+    struct VertexAttribute {
+        int size;
+        GLenum type;
+        GLboolean normalized;
+        int stride;
+        int offset;
+    };
+    VertexAttribute attributes[3];
+    GLenum index_type;
+    int index_size;
+    // buffer and first vertex the attribute pointers are set up for
+    GLuint vertex_buffer;
+    int vertex_base;
+    GLuint scene_vertex_buffer;
+    // element array buffer bound
+    GLuint index_buffer;
+    GLuint scene_index_buffer;
+
+    // counted over the last rendered frame
+    struct Statistics {
+        int draw_calls;
+        int texture_binds;
+        int uniform_uploads;
+    };
+    Statistics statistics;
+
     bool projection_matrix_dirty;
     bool light_amb_dirty;
+    bool lod_bias_dirty;
 
     void setProjectionMatrix(const QMatrix4x4 &value) {
         if (projection_matrix != value) {
             projection_matrix = value;
+            projection_serial = nextSerial();
             projection_matrix_dirty = true;
         }
     }
 
+    static int nextSerial() {
+        static QAtomicInt serial;
+        return serial.fetchAndAddRelaxed(1) + 1;
+    }
+
     void setOpacity(float value) {
         if (opacity != value)
             opacity = value;
@@ -52,9 +97,17 @@ struct RenderState {
         }
     }
 
+    void setLodBias(float value) {
+        if (lod_bias != value) {
+            lod_bias = value;
+            lod_bias_dirty = true;
+        }
+    }
+
     void setDirty() {
         projection_matrix_dirty = true;
         light_amb_dirty = true;
+        lod_bias_dirty = true;
         for (int i = 0; i < lights.size(); i++) {
             lights[i].final_pos_dirty = true;
             lights[i].light->dif_dirty = true;
@@ -62,9 +115,22 @@ struct RenderState {
         }
     }
 
+    bool isDirty() const {
+        if (projection_matrix_dirty || light_amb_dirty || lod_bias_dirty)
+            return true;
+        for (int i = 0; i < lights.size(); i++) {
+            if (lights[i].final_pos_dirty ||
+                lights[i].light->dif_dirty ||
+                lights[i].light->spec_dirty)
+                return true;
+        }
+        return false;
+    }
+
     void resetDirty() {
         projection_matrix_dirty = false;
         light_amb_dirty = false;
+        lod_bias_dirty = false;
         for (int i = 0; i < lights.size(); i++) {
             lights[i].final_pos_dirty = false;
             lights[i].light->dif_dirty = false;
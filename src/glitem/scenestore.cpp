@@ -0,0 +1,143 @@
+#include "scenestore.h"
+#include "glnode.h"
+
+
+SceneStore::~SceneStore()
+{
+    unbind();
+}
+
+void SceneStore::build(GLTransformNode *root)
+{
+    // bound nodes take their state back before it is laid out again
+    unbind();
+
+    m_parent.clear();
+    m_next.clear();
+    m_local.clear();
+    m_world.clear();
+    m_modelview.clear();
+    m_modelview_revision.clear();
+    m_animate.clear();
+    m_revision.clear();
+    m_flags.clear();
+    m_animated.clear();
+    m_names.clear();
+
+    if (root)
+        add(root, -1);
+
+    m_dirty = false;
+    m_moved = true;
+}
+
+void SceneStore::add(GLTransformNode *node, int parent)
+{
+    int i = m_nodes.size();
+    m_nodes.append(node);
+    m_parent.append(parent);
+    // already bound under another parent in this layout, the node
+    // handle points at its newest slot
+    m_next.append(node->m_store == this ? node->m_index : -1);
+    m_local.append(Affine3x4::fromMatrix(node->m_transform));
+    m_world.append(Affine3x4::fromMatrix(node->m_modelview_matrix));
+    m_modelview.append(node->m_modelview_matrix);
+    m_modelview_revision.append(node->m_revision);
+    m_animate.append(node->m_animate_node);
+    m_revision.append(node->m_revision);
+    m_flags.append(node->m_dirty ? Dirty : 0);
+    if (node->m_animate_node)
+        m_animated.append(i);
+    if (m_next[i] < 0)
+        m_names.insert(node->name(), i);
+
+    node->m_store = this;
+    node->m_index = i;
+
+    foreach (GLTransformNode *tnode, node->transformChildren()) {
+        add(tnode, i);
+    }
+}
+
+void SceneStore::unbind()
+{
+    for (int i = 0; i < m_nodes.size(); i++) {
+        GLTransformNode *node = m_nodes[i];
+        if (!node)
+            continue;
+
+        node->m_modelview_matrix = world(i);
+        node->m_revision = m_revision[i];
+        node->m_dirty = m_flags[i] & Dirty;
+        node->m_store = 0;
+    }
+    m_nodes.clear();
+}
+
+void SceneStore::update()
+{
+    for (int k = 0; k < m_animated.size(); k++) {
+        int i = m_animated[k];
+        if (m_animate[i] && m_animate[i]->isDirty()) {
+            m_flags[i] |= Dirty;
+            m_moved = true;
+        }
+    }
+
+    if (!m_moved)
+        return;
+
+    const Affine3x4 *local = m_local.constData();
+    Affine3x4 *world = m_world.data();
+    for (int i = 0; i < m_nodes.size(); i++) {
+        int p = m_parent[i];
+        bool dirty = (m_flags[i] & Dirty) || (p >= 0 && (m_flags[p] & Moved));
+        if (!dirty) {
+            m_flags[i] = 0;
+            continue;
+        }
+
+        // the world matrix of the item root is its transform
+        if (p >= 0)
+            Affine3x4::multiply(world[p], local[i], world[i]);
+        else
+            world[i] = local[i];
+        if (m_animate[i])
+            m_animate[i]->applyTo(&world[i]);
+        m_revision[i]++;
+        m_flags[i] = Moved;
+    }
+
+    m_moved = false;
+}
+
+QList<GLTransformNode *> SceneStore::find(const QString &name) const
+{
+    QList<GLTransformNode *> nodes;
+    QMultiHash<QString, int>::const_iterator it = m_names.find(name);
+    for (; it != m_names.end() && it.key() == name; ++it) {
+        GLTransformNode *node = m_nodes[it.value()];
+        if (node && !nodes.contains(node))
+            nodes.append(node);
+    }
+    return nodes;
+}
+
+void SceneStore::setAnimateNode(int i, GLAnimateNode *node)
+{
+    setDirty(i);
+    for (; i >= 0; i = m_next[i]) {
+        if (node && !m_animate[i])
+            m_animated.append(i);
+        m_animate[i] = node;
+    }
+}
+
+void SceneStore::release(int i)
+{
+    for (; i >= 0; i = m_next[i]) {
+        m_nodes[i] = 0;
+        m_animate[i] = 0;
+    }
+    m_dirty = true;
+}
@@ -0,0 +1,86 @@
+#ifndef SCENESTORE_H
+#define SCENESTORE_H
+
+#include <QVector>
+#include <QMultiHash>
+#include <QMatrix4x4>
+#include "affine3x4.h"
+
+class GLTransformNode;
+class GLAnimateNode;
+
+// Transform state of a node tree laid out in depth first order, parent
+// indices, local and world matrices in arrays and names in a side table.
+// Nodes bound to the store keep their state here and only act as handles
+// to it, world matrices are computed in one pass over the arrays with
+// parents always before their children. Laid out again with one walk
+// after the tree changes. Matrices are composed as Affine3x4, the
+// QMatrix4x4 the shaders take is made when asked for.
+class SceneStore
+{
+public:
+    SceneStore() : m_dirty(true), m_moved(false) {}
+    ~SceneStore();
+
+    // tree changed since the last build
+    bool isDirty() const { return m_dirty; }
+    void invalidate() { m_dirty = true; }
+
+    void build(GLTransformNode *root);
+    // world matrices of dirty nodes and their subtrees, dirty after
+    // their animate node changed too
+    void update();
+
+    int size() const { return m_nodes.size(); }
+    QList<GLTransformNode *> find(const QString &name) const;
+
+    // state of bound nodes by index
+    const QMatrix4x4 &world(int i) const {
+        if (m_modelview_revision[i] != m_revision[i]) {
+            m_world[i].toMatrix(m_modelview[i]);
+            m_modelview_revision[i] = m_revision[i];
+        }
+        return m_modelview[i];
+    }
+    const Affine3x4 &affine(int i) const { return m_world[i]; }
+    int revision(int i) const { return m_revision[i]; }
+    bool isDirty(int i) const { return m_flags[i] & Dirty; }
+    // a node under several parents has a slot per parent, these act on
+    // all slots of the node starting at i
+    void setDirty(int i) {
+        for (; i >= 0; i = m_next[i])
+            m_flags[i] |= Dirty;
+        m_moved = true;
+    }
+    void setAnimateNode(int i, GLAnimateNode *node);
+    // a bound node is deleted
+    void release(int i);
+
+private:
+    enum { Dirty = 1, Moved = 2 };
+
+    bool m_dirty;
+    // some node is dirty
+    bool m_moved;
+
+    QVector<GLTransformNode *> m_nodes;
+    QVector<int> m_parent;
+    // next slot of the same node or -1
+    QVector<int> m_next;
+    QVector<Affine3x4> m_local;
+    QVector<Affine3x4> m_world;
+    // world matrices as of m_modelview_revision
+    mutable QVector<QMatrix4x4> m_modelview;
+    mutable QVector<int> m_modelview_revision;
+    QVector<GLAnimateNode *> m_animate;
+    QVector<int> m_revision;
+    QVector<quint8> m_flags;
+    // nodes with an animate node
+    QVector<int> m_animated;
+    QMultiHash<QString, int> m_names;
+
+    void add(GLTransformNode *node, int parent);
+    void unbind();
+};
+
+#endif // SCENESTORE_H
@@ -0,0 +1,100 @@
+#include "sharedmodel.h"
+#include <QOpenGLContext>
+#include <QFileInfo>
+
+
+SharedModel::Registry SharedModel::m_registry;
+QMutex SharedModel::m_registry_mutex;
+
+SharedModel::~SharedModel()
+{
+    // renders release their buffers before the models drop the entry
+    qDeleteAll(m_buffers);
+
+    // a new entry may have taken the key already
+    QMutexLocker locker(&m_registry_mutex);
+    Registry::iterator it = m_registry.find(m_key);
+    if (it != m_registry.end() && it.value().isNull())
+        m_registry.erase(it);
+}
+
+QString SharedModel::key(const QString &path, const QString &tag)
+{
+    QString canonical = QFileInfo(path).canonicalFilePath();
+    if (canonical.isEmpty())
+        canonical = path;
+    return canonical + '|' + tag;
+}
+
+void SharedModel::finish(bool ok)
+{
+    QMutexLocker locker(&m_mutex);
+    m_ok = ok;
+    m_done = true;
+    m_finished.wakeAll();
+}
+
+bool SharedModel::wait()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_done)
+        m_finished.wait(&m_mutex);
+    return m_ok;
+}
+
+void SharedModel::releaseGeometry()
+{
+    QMutexLocker locker(&m_registry_mutex);
+    if (--m_users)
+        return;
+
+    // renders draw from their buffers, don't keep a CPU copy for the
+    // lifetime of the models
+    geometry.clear();
+    m_dropped = true;
+}
+
+SharedModel::Buffers *SharedModel::acquireBuffers(int layout)
+{
+    BuffersKey key(QOpenGLContext::currentContext()->shareGroup(), layout);
+
+    QMutexLocker locker(&m_mutex);
+    Buffers *buffers = m_buffers.value(key);
+    if (buffers)
+        buffers->ref_count++;
+    return buffers;
+}
+
+SharedModel::Buffers *SharedModel::addBuffers(int layout, Buffers *buffers)
+{
+    BuffersKey key(QOpenGLContext::currentContext()->shareGroup(), layout);
+
+    QMutexLocker locker(&m_mutex);
+    Buffers *added = m_buffers.value(key);
+    if (added) {
+        added->ref_count++;
+        locker.unlock();
+        delete buffers;
+        return added;
+    }
+    m_buffers.insert(key, buffers);
+    return buffers;
+}
+
+void SharedModel::releaseBuffers(Buffers *buffers)
+{
+    QMutexLocker locker(&m_mutex);
+    if (--buffers->ref_count)
+        return;
+
+    QHash<BuffersKey, Buffers *>::iterator it = m_buffers.begin();
+    while (it != m_buffers.end()) {
+        if (it.value() == buffers)
+            it = m_buffers.erase(it);
+        else
+            ++it;
+    }
+    locker.unlock();
+
+    delete buffers;
+}
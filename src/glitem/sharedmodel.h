@@ -0,0 +1,107 @@
+#ifndef SHAREDMODEL_H
+#define SHAREDMODEL_H
+
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QSharedPointer>
+#include <QWeakPointer>
+#include <QOpenGLBuffer>
+#include "geometry.h"
+#include "mesh.h"
+
+class QOpenGLContextGroup;
+
+// Loader output shared in memory by all models loading the same file
+// with the same options, in any GLItem. The first model asking for a
+// key loads it while the others wait for the result, arrays are
+// implicitly shared so taking a copy costs nothing until it's changed.
+// The geometry arrays are dropped once every model that acquired the
+// entry uploaded them, a model acquiring it later loads them again.
+// The entry lives as long as a model or render holds it, its geometry
+// is uploaded once per context share group and buffer layout and drawn
+// from there by every render of the group.
+class SharedModel
+{
+public:
+    SharedModel() : m_done(false), m_ok(false), m_users(0), m_dropped(false) {}
+    virtual ~SharedModel();
+
+    Geometry geometry;
+    QVector<Mesh> meshes;
+
+    static QString key(const QString &path, const QString &tag);
+
+    // entry for key, loading is set when the caller has to fill it in
+    // and finish() it
+    template <class T>
+    static QSharedPointer<T> acquire(const QString &key, bool &loading);
+
+    void finish(bool ok);
+    // block until the loading model finished, false when it failed
+    bool wait();
+    // called once by each model that acquired the entry when it no
+    // longer reads the geometry, uploaded or failed
+    void releaseGeometry();
+
+    // GPU copy of the geometry in one buffer layout
+    struct Buffers {
+        Buffers() : vertex(QOpenGLBuffer::VertexBuffer),
+                    index(QOpenGLBuffer::IndexBuffer), ref_count(1) {}
+
+        QOpenGLBuffer vertex;
+        QOpenGLBuffer index;
+        // ranges of each mesh in the buffers
+        QVector<QVector<Mesh::Range> > ranges;
+        int ref_count;
+    };
+
+    // buffers for layout in the current context's share group, 0 when
+    // the caller has to upload them and add them with addBuffers()
+    Buffers *acquireBuffers(int layout);
+    // the buffers drawn from, another render may have added some first
+    Buffers *addBuffers(int layout, Buffers *buffers);
+    // the last release destroys them, a context of the group is current
+    void releaseBuffers(Buffers *buffers);
+
+private:
+    QString m_key;
+    QMutex m_mutex;
+    QWaitCondition m_finished;
+    bool m_done;
+    bool m_ok;
+    // models that acquired the entry and may still read the geometry,
+    // both guarded by the registry mutex
+    int m_users;
+    bool m_dropped;
+
+    typedef QPair<QOpenGLContextGroup *, int> BuffersKey;
+    QHash<BuffersKey, Buffers *> m_buffers;
+
+    typedef QHash<QString, QWeakPointer<SharedModel> > Registry;
+    static Registry m_registry;
+    static QMutex m_registry_mutex;
+};
+
+template <class T>
+QSharedPointer<T> SharedModel::acquire(const QString &key, bool &loading)
+{
+    QMutexLocker locker(&m_registry_mutex);
+    QSharedPointer<SharedModel> entry = m_registry.value(key).toStrongRef();
+    loading = entry.isNull() || entry->m_dropped;
+    if (entry.isNull()) {
+        entry = QSharedPointer<SharedModel>(new T);
+        entry->m_key = key;
+        m_registry.insert(key, entry);
+    }
+    else if (entry->m_dropped) {
+        // only the GPU buffers are left, the caller loads the arrays again
+        QMutexLocker entry_locker(&entry->m_mutex);
+        entry->m_done = false;
+        entry->m_dropped = false;
+    }
+    entry->m_users++;
+    return entry.template staticCast<T>();
+}
+
+#endif // SHAREDMODEL_H
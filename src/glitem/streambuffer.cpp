@@ -0,0 +1,65 @@
+#include "streambuffer.h"
+
+
+StreamBuffer::StreamBuffer(const QByteArray &data, int vertex_size)
+    : m_buffer(QOpenGLBuffer::VertexBuffer),
+      m_data(data.constData(), data.size()),
+      m_vertex_size(vertex_size),
+      m_vertex_count(data.size() / vertex_size),
+      m_region(0)
+{
+    m_buffer.create();
+    m_buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+    m_buffer.bind();
+    m_buffer.allocate(m_data.size() * REGIONS);
+    for (int i = 0; i < REGIONS; i++) {
+        m_buffer.write(i * m_data.size(), m_data.constData(), m_data.size());
+        m_dirty_low[i] = m_vertex_count;
+        m_dirty_high[i] = 0;
+    }
+    m_buffer.release();
+}
+
+StreamBuffer::~StreamBuffer()
+{
+    m_buffer.destroy();
+}
+
+void StreamBuffer::update(int first, const char *data, int count)
+{
+    if (first < 0 || count <= 0 || first + count > m_vertex_count)
+        return;
+
+    memcpy(m_data.data() + first * m_vertex_size, data, count * m_vertex_size);
+    int end = first + count;
+
+    // vertices repeated for 16-bit index ranges follow
+    int copy_first = m_vertex_count - m_copies.size();
+    for (int i = 0; i < m_copies.size(); i++) {
+        int source = m_copies[i];
+        if (source >= first && source < first + count) {
+            memcpy(m_data.data() + (copy_first + i) * m_vertex_size,
+                   m_data.constData() + source * m_vertex_size, m_vertex_size);
+            end = m_vertex_count;
+        }
+    }
+
+    for (int i = 0; i < REGIONS; i++) {
+        m_dirty_low[i] = qMin(m_dirty_low[i], first);
+        m_dirty_high[i] = qMax(m_dirty_high[i], end);
+    }
+
+    // the copy drawn last frame may still be in use, write the oldest
+    m_region = (m_region + 1) % REGIONS;
+    int low = m_dirty_low[m_region];
+    int high = m_dirty_high[m_region];
+
+    m_buffer.bind();
+    m_buffer.write((base() + low) * m_vertex_size,
+                   m_data.constData() + low * m_vertex_size,
+                   (high - low) * m_vertex_size);
+    m_buffer.release();
+
+    m_dirty_low[m_region] = m_vertex_count;
+    m_dirty_high[m_region] = 0;
+}
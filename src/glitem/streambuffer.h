@@ -0,0 +1,42 @@
+#ifndef STREAMBUFFER_H
+#define STREAMBUFFER_H
+
+#include <QOpenGLBuffer>
+#include <QByteArray>
+#include <QVector>
+
+// Vertex buffer of a model changed after loading, holding a ring of
+// copies of its vertices. Each update is written to the next copy while
+// the GPU may still draw from the previous ones, only the vertices
+// changed since that copy was last written are uploaded.
+class StreamBuffer
+{
+public:
+    StreamBuffer(const QByteArray &data, int vertex_size);
+    ~StreamBuffer();
+
+    GLuint bufferId() const { return m_buffer.bufferId(); }
+    // first vertex of the copy to draw from
+    int base() const { return m_region * m_vertex_count; }
+
+    // replace vertices [first, first + count) and move to the next copy
+    void update(int first, const char *data, int count);
+    // the last sources.size() vertices repeat the vertices at sources
+    void setCopies(const QVector<uint> &sources) { m_copies = sources; }
+
+private:
+    enum { REGIONS = 3 };
+
+    QOpenGLBuffer m_buffer;
+    // current vertices, for bringing older copies up to date
+    QByteArray m_data;
+    int m_vertex_size;
+    int m_vertex_count;
+    int m_region;
+    QVector<uint> m_copies;
+    // vertex range each copy misses
+    int m_dirty_low[REGIONS];
+    int m_dirty_high[REGIONS];
+};
+
+#endif // STREAMBUFFER_H
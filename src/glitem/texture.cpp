@@ -0,0 +1,297 @@
+#include "texture.h"
+#include "ktximage.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QImageReader>
+#include <QFileInfo>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QDebug>
+
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+
+Texture::Registry Texture::m_registry;
+QMutex Texture::m_registry_mutex;
+
+class TextureDecodeTask : public QRunnable
+{
+public:
+    TextureDecodeTask(Texture *texture)
+        : m_texture(texture)
+    {}
+
+    void run() {
+        m_texture->decode();
+    }
+
+private:
+    Texture *m_texture;
+};
+
+Texture::Texture(const QString &path, const QString &key, QOpenGLTexture::WrapMode mode,
+                 Filter filter, float anisotropy)
+    : m_path(path), m_key(key), m_mode(mode), m_filter(filter),
+      m_anisotropy(anisotropy), m_ktx(0), m_ref_count(1),
+      m_done(false), m_size(0), m_acquired(1), m_shared_uploads(0)
+{
+    pool()->start(new TextureDecodeTask(this));
+}
+
+Texture::~Texture()
+{
+    // the decode task still refers to us
+    wait();
+
+    qDeleteAll(m_textures);
+    qDeleteAll(m_placeholders);
+    delete m_ktx;
+}
+
+Texture *Texture::acquire(const QString &path, QOpenGLTexture::WrapMode mode,
+                          Filter filter, float anisotropy)
+{
+    QString canonical = QFileInfo(path).canonicalFilePath();
+    if (canonical.isEmpty())
+        return 0;
+
+    if (filter != Anisotropic)
+        anisotropy = 1;
+    QString key = canonical + '|' + QString::number(mode) + '|' +
+                  QString::number(filter) + '|' + QString::number(anisotropy);
+
+    QMutexLocker locker(&m_registry_mutex);
+    Registry::iterator it = m_registry.find(key);
+    if (it != m_registry.end()) {
+        Texture *texture = it.value();
+        texture->m_ref_count++;
+        texture->m_acquired++;
+        return texture;
+    }
+
+    Texture *texture = new Texture(canonical, key, mode, filter, anisotropy);
+    m_registry.insert(key, texture);
+    return texture;
+}
+
+void Texture::release(Texture *texture)
+{
+    QMutexLocker locker(&m_registry_mutex);
+    if (--texture->m_ref_count)
+        return;
+
+    m_registry.remove(texture->m_key);
+    locker.unlock();
+
+    delete texture;
+}
+
+bool Texture::canMipmap(int width, int height)
+{
+    // GLES2 only mipmaps power of two sizes
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context->isOpenGLES() || context->format().majorVersion() >= 3 ||
+        context->hasExtension("GL_OES_texture_npot"))
+        return true;
+    return !(width & (width - 1)) && !(height & (height - 1));
+}
+
+QThreadPool *Texture::pool()
+{
+    // separate from the model loaders so decoding overlaps with parsing
+    static QThreadPool pool;
+    return &pool;
+}
+
+QImage Texture::read(const QString &path)
+{
+    QImageReader reader(path);
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "load texture " << path << " fail: " << reader.errorString();
+        return image;
+    }
+
+    // GL wants rows bottom up, flip in place instead of mirrored()
+    if (image.format() != QImage::Format_RGBA8888)
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+
+    int bpl = image.bytesPerLine();
+    QByteArray row(bpl, 0);
+    for (int top = 0, bottom = image.height() - 1; top < bottom; top++, bottom--) {
+        uchar *t = image.scanLine(top);
+        uchar *b = image.scanLine(bottom);
+        memcpy(row.data(), t, bpl);
+        memcpy(t, b, bpl);
+        memcpy(b, row.constData(), bpl);
+    }
+
+    return image;
+}
+
+void Texture::decode()
+{
+    if (KtxImage::isKtx(m_path)) {
+        KtxImage *ktx = new KtxImage;
+        if (!ktx->load(m_path)) {
+            delete ktx;
+            ktx = 0;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_ktx = ktx;
+        m_size = ktx ? ktx->dataSize() : 0;
+        m_done = true;
+        m_decoded.wakeAll();
+        return;
+    }
+
+    QImage image = read(m_path);
+
+    QMutexLocker locker(&m_mutex);
+    m_image = image;
+    m_size = image.byteCount();
+    m_done = true;
+    m_decoded.wakeAll();
+}
+
+bool Texture::wait()
+{
+    QMutexLocker locker(&m_mutex);
+    while (!m_done)
+        m_decoded.wait(&m_mutex);
+    return m_size > 0;
+}
+
+bool Texture::isDecoded()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_done;
+}
+
+QOpenGLTexture *Texture::placeholder()
+{
+    QOpenGLContextGroup *group = QOpenGLContext::currentContext()->shareGroup();
+
+    QMutexLocker locker(&m_mutex);
+    QOpenGLTexture *texture = m_placeholders.value(group);
+    if (texture)
+        return texture;
+
+    QImage image(1, 1, QImage::Format_RGBA8888);
+    image.fill(Qt::white);
+    texture = new QOpenGLTexture(image, QOpenGLTexture::DontGenerateMipMaps);
+    texture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+    texture->setWrapMode(m_mode);
+    m_placeholders.insert(group, texture);
+    return texture;
+}
+
+QOpenGLTexture *Texture::texture()
+{
+    if (!wait())
+        return 0;
+
+    QOpenGLContextGroup *group = QOpenGLContext::currentContext()->shareGroup();
+
+    QMutexLocker locker(&m_mutex);
+    QOpenGLTexture *texture = m_textures.value(group);
+    if (texture) {
+        m_shared_uploads++;
+        return texture;
+    }
+
+    bool mipmapped = false;
+    texture = upload(mipmapped);
+    if (!texture)
+        return 0;
+
+    texture->setMinificationFilter(mipmapped ? QOpenGLTexture::LinearMipMapLinear :
+                                               QOpenGLTexture::Linear);
+    texture->setMagnificationFilter(QOpenGLTexture::Linear);
+    texture->setWrapMode(m_mode);
+
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (mipmapped && m_anisotropy > 1 &&
+        context->hasExtension("GL_EXT_texture_filter_anisotropic")) {
+        GLfloat max_anisotropy = 1;
+        context->functions()->glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &max_anisotropy);
+        texture->setMaximumAnisotropy(qMin(m_anisotropy, max_anisotropy));
+    }
+    m_textures.insert(group, texture);
+    return texture;
+}
+
+QOpenGLTexture *Texture::upload(bool &mipmapped)
+{
+    QOpenGLFunctions *gl = QOpenGLContext::currentContext()->functions();
+
+    if (m_ktx && m_ktx->isSupported()) {
+        // the mapping stays for other share groups, levels stored in the
+        // file are used as they are, only uncompressed ones are generated
+        QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        texture->create();
+        texture->bind();
+        bool ok = m_ktx->upload(gl, GL_TEXTURE_2D);
+        mipmapped = m_filter != Linear && m_ktx->hasMipChain();
+        if (ok && m_filter != Linear && m_ktx->levels() == 1 && !m_ktx->isCompressed() &&
+            canMipmap(m_ktx->width(), m_ktx->height())) {
+            gl->glGenerateMipmap(GL_TEXTURE_2D);
+            mipmapped = true;
+        }
+        texture->release();
+        if (ok)
+            return texture;
+
+        qWarning() << "compressed texture upload fail, decode it: " << m_path;
+        delete texture;
+    }
+
+    // the decoded copy is dropped after the first upload, another
+    // share group needs to decode again
+    QImage image = m_image;
+    m_image = QImage();
+    if (image.isNull())
+        image = m_ktx ? m_ktx->decode() : read(m_path);
+    if (image.isNull())
+        return 0;
+
+    if (m_ktx && m_filter != Linear && m_ktx->hasMipChain()) {
+        // keep the file's levels over generated ones
+        QOpenGLTexture *texture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+        texture->create();
+        texture->bind();
+        for (int i = 0; i < m_ktx->levels(); i++) {
+            QImage level = i ? m_ktx->decode(0, i) : image;
+            gl->glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, level.width(), level.height(), 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, level.constBits());
+        }
+        texture->release();
+        mipmapped = true;
+        return texture;
+    }
+
+    mipmapped = m_filter != Linear && canMipmap(image.width(), image.height());
+    return new QOpenGLTexture(image, mipmapped ? QOpenGLTexture::GenerateMipMaps :
+                                                 QOpenGLTexture::DontGenerateMipMaps);
+}
+
+void Texture::printStatistics()
+{
+    QMutexLocker locker(&m_registry_mutex);
+
+    int hits = 0, uploads_shared = 0;
+    qint64 bytes_saved = 0;
+    foreach (Texture *texture, m_registry) {
+        QMutexLocker texture_locker(&texture->m_mutex);
+        hits += texture->m_acquired - 1;
+        uploads_shared += texture->m_shared_uploads;
+        // each hit saved a decoded image, each shared upload its GPU copy
+        bytes_saved += (texture->m_acquired - 1 + texture->m_shared_uploads) * texture->m_size;
+    }
+
+    qDebug() << "texture registry:" << m_registry.size() << "textures,"
+             << hits << "decode hits," << uploads_shared << "upload hits,"
+             << bytes_saved << "bytes saved";
+}
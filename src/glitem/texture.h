@@ -0,0 +1,90 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <QImage>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QOpenGLTexture>
+
+class QThreadPool;
+class QOpenGLContextGroup;
+class KtxImage;
+
+// Image file decoded on the texture pool as soon as it is acquired,
+// the GL texture is made from it later on the render thread. KTX files
+// are only mapped and their blocks uploaded as they are when the
+// context supports the format.
+// Textures are shared through a registry keyed by canonical path and
+// sampler settings, so a file is decoded once and uploaded once per
+// context share group however many materials and items use it.
+class Texture
+{
+public:
+    enum Filter {
+        Linear,
+        // mipmapped
+        Trilinear,
+        // mipmapped with anisotropic filtering where supported
+        Anisotropic
+    };
+
+    // return the shared texture for path, 0 when the file doesn't exist
+    static Texture *acquire(const QString &path, QOpenGLTexture::WrapMode mode,
+                            Filter filter = Trilinear, float anisotropy = 1);
+    static void release(Texture *texture);
+
+    const QString &path() const { return m_path; }
+
+    // block until the image is decoded, false when decoding failed
+    bool wait();
+    // whether decoding has finished, doesn't block
+    bool isDecoded();
+    // GL texture of the current context's share group, created on
+    // first use
+    QOpenGLTexture *texture();
+    // 1x1 white texture of the current context's share group, sampled
+    // in place of this one until it is decoded
+    QOpenGLTexture *placeholder();
+
+    // whether the current context can mipmap a texture of size
+    static bool canMipmap(int width, int height);
+
+    static QThreadPool *pool();
+    static void printStatistics();
+
+private:
+    friend class TextureDecodeTask;
+
+    Texture(const QString &path, const QString &key, QOpenGLTexture::WrapMode mode,
+            Filter filter, float anisotropy);
+    ~Texture();
+
+    QString m_path;
+    QString m_key;
+    QOpenGLTexture::WrapMode m_mode;
+    Filter m_filter;
+    float m_anisotropy;
+    QImage m_image;
+    KtxImage *m_ktx;
+    QHash<QOpenGLContextGroup *, QOpenGLTexture *> m_textures;
+    QHash<QOpenGLContextGroup *, QOpenGLTexture *> m_placeholders;
+    int m_ref_count;
+
+    QMutex m_mutex;
+    QWaitCondition m_decoded;
+    bool m_done;
+    qint64 m_size;
+    int m_acquired;
+    int m_shared_uploads;
+
+    void decode();
+    static QImage read(const QString &path);
+    QOpenGLTexture *upload(bool &mipmapped);
+
+    typedef QHash<QString, Texture *> Registry;
+    static Registry m_registry;
+    static QMutex m_registry_mutex;
+};
+
+#endif // TEXTURE_H
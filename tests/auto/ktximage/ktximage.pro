@@ -0,0 +1,9 @@
+CONFIG += testcase
+TARGET = tst_ktximage
+QT = core gui testlib
+
+INCLUDEPATH += ../../../src/glitem
+
+SOURCES += \
+    tst_ktximage.cpp \
+    ../../../src/glitem/ktximage.cpp
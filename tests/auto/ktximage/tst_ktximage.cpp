@@ -0,0 +1,122 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include "ktximage.h"
+
+class tst_KtxImage : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void valid();
+    void truncated();
+    void hugeLevelCount();
+    void levelOutOfFile();
+
+private:
+    QTemporaryDir m_dir;
+
+    static void writeU32(QByteArray &data, int pos, quint32 value);
+    static void writeU64(QByteArray &data, int pos, quint64 value);
+    // 4x4 RGBA8 KTX2 file with one level right after the level index
+    static QByteArray ktx2();
+    bool load(const QByteArray &data);
+};
+
+void tst_KtxImage::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+}
+
+void tst_KtxImage::writeU32(QByteArray &data, int pos, quint32 value)
+{
+    for (int i = 0; i < 4; i++)
+        data[pos + i] = char(value >> (i * 8));
+}
+
+void tst_KtxImage::writeU64(QByteArray &data, int pos, quint64 value)
+{
+    writeU32(data, pos, quint32(value));
+    writeU32(data, pos + 4, quint32(value >> 32));
+}
+
+QByteArray tst_KtxImage::ktx2()
+{
+    static const char identifier[12] = {
+        '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n'
+    };
+
+    QByteArray data(80 + 24 + 4 * 4 * 4, 0);
+    memcpy(data.data(), identifier, 12);
+    writeU32(data, 12, 37);     // VK_FORMAT_R8G8B8A8_UNORM
+    writeU32(data, 16, 1);      // type size
+    writeU32(data, 20, 4);      // width
+    writeU32(data, 24, 4);      // height
+    writeU32(data, 36, 1);      // faces
+    writeU32(data, 40, 1);      // levels
+    writeU64(data, 80, 104);    // level 0 offset
+    writeU64(data, 88, 64);     // level 0 length
+    writeU64(data, 96, 64);     // level 0 uncompressed length
+    return data;
+}
+
+bool tst_KtxImage::load(const QByteArray &data)
+{
+    QString path = m_dir.path() + QString("/%1.ktx2").arg(QTest::currentTestFunction());
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+        return false;
+    file.close();
+
+    KtxImage image;
+    return image.load(path);
+}
+
+void tst_KtxImage::valid()
+{
+    QVERIFY(load(ktx2()));
+}
+
+void tst_KtxImage::truncated()
+{
+    QByteArray data = ktx2();
+    data.chop(16);
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("unsupported ktx file"));
+    QVERIFY(!load(data));
+}
+
+void tst_KtxImage::hugeLevelCount()
+{
+    // 80 + levels * 24 wraps to 88 in 32 bits
+    QByteArray data = ktx2();
+    writeU32(data, 40, 0x0AAAAAAB);
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("unsupported ktx file"));
+    QVERIFY(!load(data));
+}
+
+void tst_KtxImage::levelOutOfFile()
+{
+    QByteArray data = ktx2();
+
+    // negative as a signed offset
+    writeU64(data, 80, Q_UINT64_C(0xFFFFFFFFFFFFFFC0));
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("unsupported ktx file"));
+    QVERIFY(!load(data));
+
+    // offset plus length wraps
+    writeU64(data, 80, 104);
+    writeU64(data, 88, Q_UINT64_C(0xFFFFFFFFFFFFFFF0));
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("unsupported ktx file"));
+    QVERIFY(!load(data));
+
+    // past the end of the file
+    writeU64(data, 80, data.size() + 1);
+    writeU64(data, 88, 64);
+    QTest::ignoreMessage(QtWarningMsg, QRegularExpression("unsupported ktx file"));
+    QVERIFY(!load(data));
+}
+
+QTEST_APPLESS_MAIN(tst_KtxImage)
+
+#include "tst_ktximage.moc"
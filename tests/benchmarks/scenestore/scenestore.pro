@@ -0,0 +1,17 @@
+TARGET = tst_bench_scenestore
+QT = core gui qml testlib
+CONFIG += release
+
+INCLUDEPATH += ../../../src/glitem
+
+SOURCES += \
+    tst_bench_scenestore.cpp \
+    ../../../src/glitem/affine3x4.cpp \
+    ../../../src/glitem/scenestore.cpp \
+    ../../../src/glitem/glnode.cpp \
+    ../../../src/glitem/glanimatenode.cpp \
+    ../../../src/glitem/gltransform.cpp
+
+HEADERS += \
+    ../../../src/glitem/glanimatenode.h \
+    ../../../src/glitem/gltransform.h
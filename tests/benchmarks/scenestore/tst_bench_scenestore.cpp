@@ -0,0 +1,140 @@
+#include <QtTest>
+#include "affine3x4.h"
+#include "scenestore.h"
+#include "glnode.h"
+
+// World and normal matrices of a node tree composed as QMatrix4x4, the
+// way nodes did before the scene store, against Affine3x4 and the store.
+class tst_bench_SceneStore : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void matrix4x4();
+    void affine3x4();
+    void sceneStore();
+
+private:
+    // the same tree depth first, parents before their children
+    QVector<int> m_parent;
+    QVector<QMatrix4x4> m_local;
+    GLTransformNode *m_root;
+
+    void addNodes(GLTransformNode *node, int depth);
+    QVector<QMatrix4x4> worldMatrices() const;
+};
+
+void tst_bench_SceneStore::addNodes(GLTransformNode *node, int depth)
+{
+    static const int fanout[] = { 8, 8, 16 };
+    if (depth == 3)
+        return;
+
+    int parent = m_parent.size() - 1;
+    for (int j = 0; j < fanout[depth]; j++) {
+        // small scales like models in mm units
+        QMatrix4x4 transform;
+        transform.translate(j, depth, -j);
+        transform.rotate(j * 15.0f, 0, 1, 0);
+        transform.scale(0.01f);
+
+        GLTransformNode *child = new GLTransformNode(QString("node%1").arg(m_parent.size()),
+                                                     transform);
+        node->addChild(child);
+        m_parent.append(parent);
+        m_local.append(transform);
+        addNodes(child, depth + 1);
+    }
+}
+
+QVector<QMatrix4x4> tst_bench_SceneStore::worldMatrices() const
+{
+    QVector<QMatrix4x4> world(m_local.size());
+    for (int i = 0; i < m_local.size(); i++)
+        world[i] = m_parent[i] < 0 ? m_local[i] : world[m_parent[i]] * m_local[i];
+    return world;
+}
+
+void tst_bench_SceneStore::initTestCase()
+{
+    m_root = new GLTransformNode("root");
+    m_parent.append(-1);
+    m_local.append(QMatrix4x4());
+    addNodes(m_root, 0);
+}
+
+void tst_bench_SceneStore::cleanupTestCase()
+{
+    delete m_root;
+}
+
+void tst_bench_SceneStore::matrix4x4()
+{
+    QVector<QMatrix4x4> world(m_local.size());
+    QVector<QMatrix3x3> normal(m_local.size());
+    QBENCHMARK {
+        for (int i = 0; i < m_local.size(); i++) {
+            world[i] = m_parent[i] < 0 ? m_local[i] : world[m_parent[i]] * m_local[i];
+            normal[i] = world[i].normalMatrix();
+        }
+    }
+}
+
+void tst_bench_SceneStore::affine3x4()
+{
+    QVector<Affine3x4> local(m_local.size());
+    for (int i = 0; i < m_local.size(); i++)
+        local[i] = Affine3x4::fromMatrix(m_local[i]);
+
+    QVector<Affine3x4> world(m_local.size());
+    QVector<QMatrix3x3> normal(m_local.size());
+    QBENCHMARK {
+        for (int i = 0; i < local.size(); i++) {
+            if (m_parent[i] < 0)
+                world[i] = local[i];
+            else
+                Affine3x4::multiply(world[m_parent[i]], local[i], world[i]);
+            normal[i] = world[i].normalMatrix();
+        }
+    }
+
+    // same results as QMatrix4x4, small scales aren't taken as singular
+    QVector<QMatrix4x4> expect = worldMatrices();
+    for (int i = 0; i < expect.size(); i++) {
+        QMatrix4x4 result;
+        world[i].toMatrix(result);
+        QMatrix3x3 expect_normal = expect[i].normalMatrix();
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++)
+                QVERIFY(qAbs(result(r, c) - expect[i](r, c)) <= 1e-4f * qAbs(expect[i](r, c)) + 1e-6f);
+        }
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++)
+                QVERIFY(qAbs(normal[i](r, c) - expect_normal(r, c)) <= 1e-3f * qAbs(expect_normal(r, c)) + 1e-3f);
+        }
+    }
+}
+
+void tst_bench_SceneStore::sceneStore()
+{
+    SceneStore store;
+    store.build(m_root);
+    QList<GLTransformNode *> nodes;
+    nodes.append(m_root);
+    for (int k = 0; k < nodes.size(); k++)
+        nodes.append(nodes[k]->transformChildren());
+
+    QBENCHMARK {
+        m_root->setDirty();
+        store.update();
+        foreach (GLTransformNode *node, nodes)
+            node->normalMatrix();
+    }
+}
+
+QTEST_APPLESS_MAIN(tst_bench_SceneStore)
+
+#include "tst_bench_scenestore.moc"